@@ -0,0 +1,139 @@
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <random>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "../libs/name_table.h"
+
+/*
+Reader contention on user names: N readers resolve random ids and look names up while one writer interns and
+releases names nonstop, so the name index keeps being rebuilt under them.
+./name_table_bench [readers=32] [mode=epoch|mutex] [seconds=2]
+mode=mutex runs the same load against a shared_mutex-guarded map, the directory NameTable replaced.
+*/
+
+#define BENCH_NAMES         		1024
+#define BENCH_BATCH         		256 // reads between stop checks
+
+namespace {
+struct LockedNames { // the baseline: one shared_mutex over an id -> name map and its reverse
+    std::shared_mutex mtx;
+    std::unordered_map<user_id_t, std::string> names;
+    std::unordered_map<std::string, user_id_t> ids;
+    user_id_t next = 1;
+
+    user_id_t intern(const std::string& name) {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        names.emplace(next, name);
+        ids.emplace(name, next);
+        return next++;
+    }
+    void release(const user_id_t id) {
+        std::unique_lock<std::shared_mutex> lock(mtx);
+        auto it = names.find(id);
+        if (it == names.end()) return;
+        ids.erase(it->second);
+        names.erase(it);
+    }
+    user_id_t find(const std::string& name) {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        auto it = ids.find(name);
+        return it == ids.end() ? NO_USER : it->second;
+    }
+    template <typename F>
+    bool with_name(const user_id_t id, F&& fn) {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        auto it = names.find(id);
+        if (it == names.end()) return false;
+        fn(std::string_view(it->second));
+        return true;
+    }
+};
+
+template <typename Table>
+void run(Table& table, const int readers, const int seconds) {
+    std::vector<std::string> names;
+    std::vector<user_id_t> ids;
+    for (int i = 0; i < BENCH_NAMES; i++) {
+        names.push_back("user_" + std::to_string(i));
+        ids.push_back(table.intern(names.back()));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0}, bad{0};
+    std::atomic<user_id_t> churn{NO_USER}; // the writer's latest name, may be gone by the time it is read
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            std::mt19937 rng(r);
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int k = 0; k < BENCH_BATCH; k++) {
+                    if (!table.with_name(ids[rng() % BENCH_NAMES], [&](std::string_view s) { if (s.compare(0, 5, "user_")) bad++; })) bad++;
+                    table.with_name(churn.load(std::memory_order_relaxed), [&](std::string_view s) { if (s.compare(0, 4, "tmp_")) bad++; });
+                    size_t j = rng() % BENCH_NAMES;
+                    if (table.find(names[j]) != ids[j]) bad++;
+                    n += 3;
+                }
+            }
+            reads += n;
+        });
+    }
+
+    uint64_t writes = 0;
+    std::thread writer([&]() {
+        for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+            user_id_t id = table.intern("tmp_" + std::to_string(i % 5000));
+            churn.store(id, std::memory_order_relaxed);
+            table.release(id);
+            writes++;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (std::thread& t : threads) t.join();
+    writer.join();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("readers=%d reads/s=%.1fM writes/s=%.1fk bad=%lu\n", readers, reads / s / 1e6, writes / s / 1e3, static_cast<unsigned long>(bad.load()));
+}
+
+struct InternedNames { // NameTable is static, this only gives it the same shape as LockedNames
+    user_id_t intern(const std::string& name) { return NameTable::intern(name); }
+    void release(const user_id_t id) { NameTable::release(id); }
+    user_id_t find(const std::string& name) { return NameTable::find(name); }
+    template <typename F>
+    bool with_name(const user_id_t id, F&& fn) { return NameTable::with_name(id, std::forward<F>(fn)); }
+};
+}
+
+int main(int argc, char** argv) {
+    int readers = 32, seconds = 2;
+    bool locked = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "readers=", 8) == 0) {
+            readers = std::max(1, atoi(argv[i] + 8));
+        } else if (strncmp(argv[i], "mode=", 5) == 0) {
+            locked = strcmp(argv[i] + 5, "mutex") == 0;
+        } else if (strncmp(argv[i], "seconds=", 8) == 0) {
+            seconds = std::max(1, atoi(argv[i] + 8));
+        }
+    }
+
+    printf("%s: ", locked ? "shared_mutex" : "NameTable");
+    if (locked) {
+        LockedNames table;
+        run(table, readers, seconds);
+    } else {
+        InternedNames table;
+        run(table, readers, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../libs/json.h"
+#include "../libs/request_codec.h"
+
+/*
+Per-frame decode cost of the client requests: RequestDecoder against the path it replaced, json_loadb() into a
+DOM then json_unpack() for the type and once more for the members.
+./request_codec_bench [frames=1000000] [mode=both|decoder|jansson]
+*/
+
+#define BENCH_TEXT          		"hello, how is everyone doing today?"
+
+namespace {
+struct Sample {
+    const char* name;
+    std::string frame;
+};
+
+volatile uint64_t sink; // keeps the decoded fields observable
+
+bool jansson_decode(const std::string& frame, uint64_t& acc) {
+    json_error_t err;
+    Json root(json_loadb(frame.data(), frame.size(), 0, &err));
+    if (root.get() == nullptr) return false;
+    const char* type;
+    __UNPACK_JSON(root, "{s:s}", "type", &type) {
+        json_int_t channel_id, timestamp;
+        const char* text;
+        if (strcmp(type, "join") == 0) {
+            __UNPACK_JSON(root, "{s:I,s:I,s:s}", "channel_id", &channel_id, "timestamp", &timestamp, "user_name", &text) {
+                acc += channel_id + timestamp + strlen(text);
+                return true;
+            }
+        } else {
+            __UNPACK_JSON(root, "{s:s,s:I}", "text", &text, "timestamp", &timestamp) {
+                acc += timestamp + strlen(text);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool decoder_decode(RequestDecoder& decoder, const std::string& frame, uint64_t& acc) {
+    WireRequest req;
+    if (!decoder.decode(frame, req)) return false;
+    acc += req.channel_id + req.timestamp + req.user_name.size() + req.text.size();
+    return true;
+}
+
+template <typename F>
+void run(const char* label, const Sample& s, const long frames, F&& decode) {
+    uint64_t acc = 0, bad = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < frames; i++) {
+        if (!decode(s.frame, acc)) bad++;
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = acc;
+    printf("%-8s %-8s ns/frame=%.1f frames/s=%.2fM bad=%lu\n", label, s.name, sec * 1e9 / frames, frames / sec / 1e6, static_cast<unsigned long>(bad));
+}
+}
+
+int main(int argc, char** argv) {
+    long frames = 1000000;
+    bool decoder = true, jansson = true;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "frames=", 7) == 0) {
+            frames = std::max(1L, atol(argv[i] + 7));
+        } else if (strncmp(argv[i], "mode=", 5) == 0) {
+            decoder = strcmp(argv[i] + 5, "jansson") != 0;
+            jansson = strcmp(argv[i] + 5, "decoder") != 0;
+        }
+    }
+
+    std::vector<Sample> samples = {
+        {"join", R"({"type":"join","user_name":"user_417","channel_id":12,"timestamp":1760680000123})"},
+        {"message", std::string(R"({"type":"message","text":")") + BENCH_TEXT + R"(","timestamp":1760680000123})"},
+        {"escaped", R"({"type":"message","text":"line one\nline \"two\" café","timestamp":1760680000123})"}, // through the scratch buffer
+        {"1k", R"({"type":"message","text":")" + std::string(1024, 'x') + R"(","timestamp":1760680000123})"},
+    };
+
+    RequestDecoder codec;
+    for (const Sample& s : samples) {
+        if (decoder) run("decoder", s, frames, [&](const std::string& f, uint64_t& acc) { return decoder_decode(codec, f, acc); });
+        if (jansson) run("jansson", s, frames, jansson_decode);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "../libs/task_runner.h"
+
+/*
+Tick cost of a TaskRunner pipeline while other threads push once-tasks into it, the way channels post work to a
+lobby: one thread runs ticks of sessions*tasks trivial tasks, P pushers add once-tasks nonstop.
+./task_runner_bench [mode=frozen|locked] [pushers=cores-1] [sessions=4] [tasks=8] [seconds=2]
+mode=locked never freezes, so every tick and every push takes the runner's mutex, as before freeze() existed.
+*/
+
+#define BENCH_OUTSTANDING   		4096 // once-tasks a pusher may have queued before it waits for the ticks
+#define BENCH_BATCH         		64 // ticks between stop checks
+
+namespace {
+struct alignas(64) Pusher {
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> done{0};
+};
+}
+
+int main(int argc, char** argv) {
+    bool locked = false;
+    int pushers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1), sessions = 4, tasks = 8, seconds = 2;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "mode=", 5) == 0) {
+            locked = strcmp(argv[i] + 5, "locked") == 0;
+        } else if (strncmp(argv[i], "pushers=", 8) == 0) {
+            pushers = std::max(0, atoi(argv[i] + 8));
+        } else if (strncmp(argv[i], "sessions=", 9) == 0) {
+            sessions = std::max(1, atoi(argv[i] + 9));
+        } else if (strncmp(argv[i], "tasks=", 6) == 0) {
+            tasks = std::max(1, atoi(argv[i] + 6));
+        } else if (strncmp(argv[i], "seconds=", 8) == 0) {
+            seconds = std::max(1, atoi(argv[i] + 8));
+        }
+    }
+
+    TaskRunner<void()> runner;
+    uint64_t calls = 0; // the runner thread's only
+    runner.new_session(sessions);
+    for (int s = 0; s < sessions; s++) {
+        for (int t = 0; t < tasks; t++) runner.pushb(s, [&calls]() { calls++; });
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<Pusher> counts(std::max(1, pushers));
+    std::atomic<int> ready{0};
+    std::vector<std::thread> threads;
+    uint64_t ticks = 0;
+    double elapsed = 0;
+    std::thread ticker([&]() {
+        if (!locked) runner.freeze(); // from the thread that calls run()
+        ready++;
+        while (ready.load() < pushers + 1) std::this_thread::yield();
+        auto start = std::chrono::steady_clock::now();
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int k = 0; k < BENCH_BATCH; k++) runner.run();
+            ticks += BENCH_BATCH;
+        }
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+    while (ready.load() < 1) std::this_thread::yield(); // pushes only once the runner is frozen
+
+    for (int p = 0; p < pushers; p++) {
+        threads.emplace_back([&, p]() {
+            Pusher& mine = counts[p];
+            ready++;
+            for (unsigned int i = 0; !stop.load(std::memory_order_relaxed); i++) {
+                if (mine.pushed.load(std::memory_order_relaxed) - mine.done.load(std::memory_order_relaxed) >= BENCH_OUTSTANDING) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                mine.pushed.fetch_add(1, std::memory_order_relaxed);
+                runner.push_onceb(i % sessions, [&mine]() { mine.done.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    ticker.join();
+    for (std::thread& t : threads) t.join();
+
+    uint64_t once = 0;
+    for (int p = 0; p < pushers; p++) once += counts[p].done.load();
+    printf("%s: sessions=%d tasks=%d pushers=%d ticks/s=%.2fM ns/tick=%.1f once/s=%.2fM calls=%lu\n", locked ? "locked" : "frozen",
+        sessions, tasks, pushers, ticks / elapsed / 1e6, elapsed * 1e9 / ticks, once / elapsed / 1e6, static_cast<unsigned long>(calls));
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "binary_communication.h"
+
+BinaryCommunication::BinaryCommunication(ConnectionTracker* tracker, IoEngine* engine): Communication(tracker, engine) {}
+
+Frame BinaryCommunication::encode_binary(const std::string& payload) {
+	if (payload.size() > MAX_BINARY_FRAME_SIZE) {
+		throw std::runtime_error("Frame too large.");
+	}
+	uint32_t len = static_cast<uint32_t>(payload.size());
+
+	auto framed = std::make_shared<std::string>();
+	framed->resize(4 + payload.size());
+	char* p = framed->data();
+	p[0] = static_cast<char>(len >> 24);
+	p[1] = static_cast<char>(len >> 16);
+	p[2] = static_cast<char>(len >> 8);
+	p[3] = static_cast<char>(len);
+	framed->replace(4, payload.size(), payload);
+
+	return framed;
+}
+
+std::vector<fd_t> BinaryCommunication::broadcast(const std::vector<fd_t>& clients, const std::string& payload, const std::shared_ptr<void>& keep) {
+	std::vector<fd_t> failed_fds;
+	if (payload.empty()) return failed_fds;
+
+	Frame frames[MODE_COUNT]; // encoded on first use
+	bool broken[MODE_COUNT] = {}; // failed to encode, skipped for the rest
+	size_t skipped = 0;
+	for (const fd_t& fd : clients) {
+		FrameMode mode = mode_of(fd);
+		if (mode == HEX && payload.size() > MAX_FRAME_SIZE) { // the 4-digit header cannot carry it
+			skipped++;
+			continue;
+		}
+
+		Frame& frame = frames[mode];
+		if (broken[mode]) continue;
+		try {
+			if (!frame) frame = attach(mode == BINARY ? encode_binary(payload) : encode_frame(payload), keep);
+		} catch (const std::exception& e) {
+			ERROR("Broadcast of %zu bytes dropped: %s", payload.size(), e.what()); // nobody in this format gets it, nobody is blamed for it
+			broken[mode] = true;
+			continue;
+		}
+		try {
+			send_encoded(fd, frame);
+		} catch (const std::exception&) {
+			failed_fds.push_back(fd);
+		}
+	}
+	if (skipped > 0) {
+		ERROR("Broadcast of %zu bytes skipped for %zu hex-framed connections.", payload.size(), skipped);
+	}
+
+	return failed_fds;
+}
+
+size_t BinaryCommunication::max_payload() const {
+	return MAX_BINARY_FRAME_SIZE;
+}
+
+size_t BinaryCommunication::max_payload(const fd_t fd) {
+	return mode_of(fd) == BINARY ? MAX_BINARY_FRAME_SIZE : MAX_FRAME_SIZE;
+}
+
+BinaryCommunication::FrameMode BinaryCommunication::mode_of(const fd_t fd) {
+	return static_cast<FrameMode>(ConnectionTable::at(fd).frame_mode);
+}
+
+#pragma region PROTECTED_FUNC
+Frame BinaryCommunication::encode_for(const fd_t fd, const std::string& payload) {
+	return mode_of(fd) == BINARY ? encode_binary(payload) : encode_frame(payload);
+}
+
+bool BinaryCommunication::parse_frame(const fd_t fd, RecvBuffer& buf, std::string_view& out) {
+	while (buf.tail - buf.head >= 4) {
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(buf.data.data() + buf.head);
+		if (p[0] != 0) { // ASCII hex digit
+			ConnectionTable::at(fd).frame_mode = HEX;
+			return Communication::parse_frame(fd, buf, out);
+		}
+		ConnectionTable::at(fd).frame_mode = BINARY;
+
+		uint32_t len = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+		if (len > MAX_BINARY_FRAME_SIZE) {
+			throw runtime_errorf("Frame too large from fd %d", fd);
+		} else if (len == 0) {
+			buf.head += 4;
+			continue;
+		} else if (buf.tail - buf.head < 4 + len) {
+			return false; // wait for full frame
+		}
+
+		out = std::string_view(buf.data.data() + buf.head + 4, len);
+		buf.head += 4 + len;
+		return true;
+	}
+	return false;
+}
+#pragma endregion
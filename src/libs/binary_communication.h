@@ -0,0 +1,37 @@
+#ifndef __BINARY_COMMUNICATION_H__
+#define __BINARY_COMMUNICATION_H__
+
+#define MAX_BINARY_FRAME_SIZE       (1024 * 1024)
+
+#include "communication.h"
+
+/*
+Binary frame: 4-byte big-endian length + payload.
+A binary header always starts with 0x00 (length < 16 MiB) while a hex header starts with an ASCII digit,
+so the format is told apart on every header and negotiated by the client's first frame.
+The negotiated format is kept in the ConnectionTable slot and follows the connection from the lobby into channels.
+Connections that never sent a binary header keep the hex format and its MAX_FRAME_SIZE.
+*/
+
+class BinaryCommunication : public Communication {
+	public:
+		enum FrameMode : uint8_t {
+			HEX = 0,
+			BINARY = 1,
+			MODE_COUNT = 2
+		};
+	public:
+		BinaryCommunication(ConnectionTracker* tracker = nullptr, IoEngine* engine = nullptr);
+
+		Frame encode_binary(const std::string& payload);
+		virtual std::vector<fd_t> broadcast(const std::vector<fd_t>& clients, const std::string& payload, const std::shared_ptr<void>& keep = nullptr) override; // encodes once per format in use
+		virtual size_t max_payload() const override; // MAX_BINARY_FRAME_SIZE
+		virtual size_t max_payload(const fd_t fd) override;
+
+		FrameMode mode_of(const fd_t fd); // HEX until the connection sent a binary header
+	protected:
+		virtual Frame encode_for(const fd_t fd, const std::string& payload) override;
+		virtual bool parse_frame(const fd_t fd, RecvBuffer& buf, std::string_view& out) override;
+};
+
+#endif
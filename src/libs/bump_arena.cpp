@@ -0,0 +1,43 @@
+#include <cstring>
+#include <algorithm>
+
+#include "bump_arena.h"
+
+BumpArena::BumpArena(): cur(0), used(0) {}
+
+char* BumpArena::alloc(const size_t n) {
+    while (cur < chunks.size()) {
+        Chunk& c = chunks[cur];
+        if (c.size - used >= n) {
+            char* p = c.mem.get() + used;
+            used += n;
+            return p;
+        }
+        cur++; // the tail of this chunk stays unused until reset()
+        used = 0;
+    }
+
+    size_t size = std::max<size_t>(ARENA_CHUNK, n);
+    chunks.push_back(Chunk{std::unique_ptr<char[]>(new char[size]), size});
+    cur = chunks.size() - 1;
+    used = n;
+    return chunks[cur].mem.get();
+}
+
+std::string_view BumpArena::copy(std::string_view s) {
+    if (s.empty()) return std::string_view();
+    char* p = alloc(s.size());
+    memcpy(p, s.data(), s.size());
+    return std::string_view(p, s.size());
+}
+
+void BumpArena::reset() {
+    cur = 0;
+    used = 0;
+}
+
+size_t BumpArena::capacity() const {
+    size_t total = 0;
+    for (const Chunk& c : chunks) total += c.size;
+    return total;
+}
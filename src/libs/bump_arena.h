@@ -0,0 +1,36 @@
+#ifndef __BUMP_ARENA_H__
+#define __BUMP_ARENA_H__
+
+#define ARENA_CHUNK         		65536
+
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <cstddef>
+
+/*
+Bump allocator for data that dies all at once, e.g. a broadcast window.
+Allocation is a pointer bump inside the current chunk, reset() rewinds to the first chunk in O(1).
+Chunks are kept for the next round, so once the high-water mark is reached nothing is allocated anymore.
+Not thread-safe, nothing is destructed: store trivially destructible data or views.
+*/
+
+class BumpArena {
+    private:
+        struct Chunk {
+            std::unique_ptr<char[]> mem;
+            size_t size;
+        };
+        std::vector<Chunk> chunks;
+        size_t cur; // chunk being filled
+        size_t used; // bytes of chunks[cur] handed out
+    public:
+        BumpArena();
+
+        char* alloc(const size_t n); // larger than ARENA_CHUNK gets a chunk of its own
+        std::string_view copy(std::string_view s);
+        void reset();
+        size_t capacity() const;
+};
+
+#endif
@@ -1,86 +1,125 @@
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <sys/socket.h>
 #include <cerrno>
 
 #include "communication.h"
+#include "metrics.h"
+
+Communication::Communication(ConnectionTracker* tracker, IoEngine* engine): dispatching(FD_ERR), dispatch_dropped(false), dispatch_released(false), tracker(tracker), engine(engine ? engine : new SyscallEngine()) {}
 
 Communication::~Communication() {
-	rbuf.clear();
-}
-
-std::vector<std::string> Communication::recv_frame(const fd_t fd) {
-	// NEEDS: attach 4-byte length header to each frame
-
-	std::vector<std::string> frames;
-    std::string& acc = rbuf[fd];
-    char buf[4096];
-
-    while (true) {
-        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-            throw std::runtime_error("Recv failed.");
-        } else if (n == 0) {
-            throw runtime_errorf(DISCONNECTED_BY_FIN, "Disconnected: fd %d", fd);
-        }
-        acc.append(buf, n);
-        if (n < 4096) break;
-    }
+	delete engine;
+}
 
-    while (acc.size() >= 4) {
-        uint32_t len = 0;
-        try {
-            len = std::stoul(acc.substr(0, 4), nullptr, 16);
-        } catch (...) {
-            throw std::runtime_error("Invalid frame header.");
-        }
-
-        if (len > MAX_FRAME_SIZE) {
-            throw runtime_errorf("Frame too large from fd %d", fd);
-        } else if (len == 0) {
-            acc.erase(0, 4);
-            continue;
-        } else if (acc.size() < 4 + len) {
-            break; // wait for full frame
-        }
-        
-        std::string payload = acc.substr(4, len);
-		frames.push_back(payload);
-
-        acc.erase(0, 4 + len);
-    }
+void Communication::recv_frame(const fd_t fd, const FrameHandler& on_frame) {
+	Connection& conn = ConnectionTable::at(fd);
+	RecvBuffer& buf = conn.rbuf;
+
+	dispatching = fd;
+	dispatch_dropped = dispatch_released = false;
+	try {
+		while (true) {
+			size_t n = fill(fd, buf);
+			size_t room = buf.data.size() - buf.tail;
+			conn.stats.bytes_in += n;
+			if (n) Metrics::add(M_BYTES_IN, n);
 
-	return frames;
+			std::string_view frame;
+			while (!dispatch_dropped && parse_frame(fd, buf, frame)) {
+				conn.stats.frames_in++;
+				Metrics::add(M_FRAMES_IN);
+				on_frame(frame);
+			}
+			if (dispatch_dropped) break;
+
+			if (buf.head == buf.tail) { // everything consumed => rewind without moving bytes
+				buf.head = buf.tail = 0;
+			}
+			if (n == 0) break; // EAGAIN
+			if (room > 0 && !(tracker && tracker->is_edge())) break; // short read; level-triggered polling reports the rest
+		}
+	} catch (...) {
+		end_dispatch(fd, buf);
+		throw;
+	}
+	end_dispatch(fd, buf);
 }
-void Communication::send_frame(const fd_t fd, const std::string& payload) {
+Frame Communication::encode_frame(const std::string& payload) {
 	uint32_t len = static_cast<uint32_t>(payload.size());
-    if (len == 0) return;
     if (len > MAX_FRAME_SIZE) {
         throw std::runtime_error("Frame too large.");
     }
 
+    auto framed = std::make_shared<std::string>();
+    framed->resize(4 + payload.size());
     char header[5];
     std::snprintf(header, sizeof(header), "%04x", len);
+    framed->replace(0, 4, header, 4);
+    framed->replace(4, payload.size(), payload);
 
-    ssize_t sent = send(fd, header, 4, MSG_NOSIGNAL); // MSG_NOSIGNAL => prevent SIGPIPE abort
-    if (sent != 4) {
-        throw std::runtime_error("Invalid header sent.");
-    }
+    return framed;
+}
+void Communication::send_frame(const fd_t fd, const std::string& payload) {
+    if (payload.empty()) return;
+    send_encoded(fd, encode_for(fd, payload));
+}
+void Communication::send_encoded(const fd_t fd, const Frame& frame) {
+	Connection& conn = ConnectionTable::at(fd);
+	OutQueue& q = conn.wbuf;
+	conn.stats.frames_out++;
+	conn.stats.bytes_out += frame->size();
+	Metrics::add(M_FRAMES_OUT);
+	Metrics::add(M_BYTES_OUT, frame->size());
 
-    size_t total = 0;
-    while (total < payload.size()) {
-        ssize_t n = send(fd, payload.data() + total, payload.size() - total, MSG_NOSIGNAL);
-        if (n <= 0) {
-            throw std::runtime_error("Minus frame.");
-        }
-        total += static_cast<size_t>(n);
-    }
+	size_t off = 0;
+	if (q.chunks.empty() && !engine->is_async()) { // nothing queued => header and payload in one syscall
+		while (off < frame->size()) {
+			ssize_t n = send(fd, frame->data() + off, frame->size() - off, MSG_DONTWAIT | MSG_NOSIGNAL); // MSG_NOSIGNAL => prevent SIGPIPE abort
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+				throw runtime_errorf("Send failed: fd %d", fd);
+			}
+			off += static_cast<size_t>(n);
+		}
+		if (off == frame->size()) return;
+
+		if (tracker) tracker->watch_writable(fd, true); // throws before anything is queued
+		q.armed = true;
+	}
+
+	if (!q.chunks.empty() && q.bytes + frame->size() - off > MAX_OUTBOUND_SIZE) { // a single frame is always taken, it may exceed the limit on its own
+		throw runtime_errorf(SEND_OVERFLOW, "Outbound queue overflow: fd %d", fd);
+	}
+	q.chunks.push_back({frame, off}); // keeps a reference, never a copy
+	q.bytes += frame->size() - off;
+
+	if (engine->is_async() && !q.armed) {
+		settle(fd, q, engine->drain(fd, q)); // only prepared here, issued by submit()
+	}
+}
+void Communication::send_direct(const fd_t fd, const std::string& payload) noexcept {
+	try {
+		Frame frame = encode_for(fd, payload);
+		if (send(fd, frame->data(), frame->size(), MSG_DONTWAIT | MSG_NOSIGNAL) > 0) Metrics::add(M_FRAMES_OUT); // a short write is left as is
+	} catch (...) {} // the caller closes fd either way
 }
-std::vector<fd_t> Communication::broadcast(const std::unordered_set<fd_t>& clients, const std::string& payload) {
+
+std::vector<fd_t> Communication::broadcast(const std::vector<fd_t>& clients, const std::string& payload, const std::shared_ptr<void>& keep) {
 	std::vector<fd_t> failed_fds;
+	if (payload.empty()) return failed_fds;
+
+	Frame frame;
+	try {
+		frame = attach(encode_frame(payload), keep);
+	} catch (const std::exception& e) {
+		ERROR("Broadcast of %zu bytes dropped: %s", payload.size(), e.what()); // nobody gets it, nobody is blamed for it
+		return failed_fds;
+	}
 	for (const fd_t& fd : clients) {
 		try {
-			send_frame(fd, payload);
+			send_encoded(fd, frame);
 		} catch (const std::exception&) {
 			failed_fds.push_back(fd);
 		}
@@ -89,6 +128,180 @@ std::vector<fd_t> Communication::broadcast(const std::unordered_set<fd_t>& clien
 	return failed_fds;
 }
 
+size_t Communication::max_payload() const {
+	return MAX_FRAME_SIZE;
+}
+
+size_t Communication::max_payload(const fd_t fd) {
+	return MAX_FRAME_SIZE;
+}
+
+void Communication::open(const fd_t fd) {
+	ConnectionTable::open(fd, this);
+}
+
+bool Communication::claim(const fd_t fd) {
+	return ConnectionTable::claim(fd, this);
+}
+
+bool Communication::flush(const fd_t fd) {
+	OutQueue& q = ConnectionTable::at(fd).wbuf;
+	if (q.chunks.empty()) return true;
+
+	return settle(fd, q, engine->drain(fd, q));
+}
+
+std::vector<fd_t> Communication::submit() {
+	std::vector<fd_t> failed;
+	if (engine->is_async()) {
+		pump();
+		failed.swap(failed_fds);
+	}
+	return failed;
+}
+
+bool Communication::release(const fd_t fd) {
+	bool drained = false;
+	try {
+		drained = flush(fd);
+		for (int i = 0; !drained && engine->is_async() && i < 4; i++) { // the next owner must not race a write in flight
+			pump();
+			drained = ConnectionTable::at(fd).wbuf.chunks.empty();
+		}
+	} catch (...) {}
+	clear_buffer(fd);
+
+	if (fd == dispatching) {
+		dispatch_released = true; // handed over once recv_frame stops touching the buffer
+	} else {
+		ConnectionTable::release(fd, this);
+	}
+	return drained;
+}
+
 void Communication::clear_buffer(const fd_t fd) {
-	rbuf.erase(fd);
-}
\ No newline at end of file
+	Connection& conn = ConnectionTable::at(fd);
+	if (fd == dispatching) {
+		dispatch_dropped = true; // reset by recv_frame once the handler returns
+	} else {
+		conn.rbuf.head = conn.rbuf.tail = 0;
+	}
+
+	if (conn.wbuf.inflight) {
+		pump(); // a prepared write still names this fd, it must not reach whoever gets the number next
+	}
+	conn.wbuf = OutQueue();
+}
+
+#pragma region PROTECTED_FUNC
+Frame Communication::attach(Frame frame, const std::shared_ptr<void>& keep) {
+	if (!keep) return frame;
+	auto both = std::make_shared<std::pair<Frame, std::shared_ptr<void>>>(std::move(frame), keep);
+	return Frame(both, both->first.get()); // aliasing: points at the bytes, owns the pair
+}
+
+Frame Communication::encode_for(const fd_t fd, const std::string& payload) {
+	return encode_frame(payload);
+}
+
+size_t Communication::fill(const fd_t fd, RecvBuffer& buf) {
+	if (buf.data.size() - buf.tail < RECV_CHUNK) {
+		if (buf.head > 0) { // compact: move the unparsed remainder to the front
+			std::memmove(buf.data.data(), buf.data.data() + buf.head, buf.tail - buf.head);
+			buf.tail -= buf.head;
+			buf.head = 0;
+		}
+		if (buf.data.size() - buf.tail < RECV_CHUNK) {
+			buf.data.resize(std::max(buf.data.size() * 2, buf.tail + RECV_CHUNK));
+		}
+	}
+
+	ssize_t n = recv(fd, buf.data.data() + buf.tail, buf.data.size() - buf.tail, MSG_DONTWAIT);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+		throw std::runtime_error("Recv failed.");
+	} else if (n == 0) {
+		throw runtime_errorf(DISCONNECTED_BY_FIN, "Disconnected: fd %d", fd);
+	}
+	buf.tail += static_cast<size_t>(n);
+	return static_cast<size_t>(n);
+}
+
+bool Communication::parse_frame(const fd_t fd, RecvBuffer& buf, std::string_view& out) {
+	while (buf.tail - buf.head >= 4) {
+		const char* p = buf.data.data() + buf.head;
+		uint32_t len = 0;
+		for (int i = 0; i < 4; i++) {
+			int v = hex_value(p[i]);
+			if (v < 0) {
+				throw std::runtime_error("Invalid frame header.");
+			}
+			len = (len << 4) | static_cast<uint32_t>(v);
+		}
+
+		if (len > MAX_FRAME_SIZE) {
+			throw runtime_errorf("Frame too large from fd %d", fd);
+		} else if (len == 0) {
+			buf.head += 4;
+			continue;
+		} else if (buf.tail - buf.head < 4 + len) {
+			return false; // wait for full frame
+		}
+
+		out = std::string_view(p + 4, len);
+		buf.head += 4 + len;
+		return true;
+	}
+	return false;
+}
+#pragma endregion
+
+#pragma region PRIVATE_FUNC
+void Communication::end_dispatch(const fd_t fd, RecvBuffer& buf) {
+	dispatching = FD_ERR;
+	if (dispatch_dropped) buf.head = buf.tail = 0;
+	if (dispatch_released) ConnectionTable::release(fd, this);
+}
+
+bool Communication::settle(const fd_t fd, OutQueue& q, const DrainResult r) {
+	if (r == DrainResult::BLOCKED) {
+		if (!q.armed) {
+			if (tracker) tracker->watch_writable(fd, true);
+			q.armed = true;
+		}
+		return false;
+	}
+
+	bool armed = q.armed; // drained or handed to the kernel, either way EPOLLOUT has nothing left to report
+	q.armed = false;
+	if (r == DrainResult::DRAINED) q = OutQueue();
+	if (armed && tracker) tracker->watch_writable(fd, false);
+	return r == DrainResult::DRAINED;
+}
+
+void Communication::pump() {
+	engine->submit([this](const fd_t fd, const uint64_t tag, const ssize_t res) {
+		complete(fd, tag, res);
+	});
+}
+
+void Communication::complete(const fd_t fd, const uint64_t tag, const ssize_t res) {
+	Connection& conn = ConnectionTable::at(fd);
+	OutQueue& q = conn.wbuf;
+	if (conn.owner.load(std::memory_order_acquire) != this || q.inflight != tag) return; // dropped or handed over meanwhile
+
+	q.inflight = 0;
+	try {
+		if (res == -EAGAIN || res == -EWOULDBLOCK) {
+			settle(fd, q, DrainResult::BLOCKED);
+			return;
+		} else if (res < 0) {
+			throw runtime_errorf("Send failed: fd %d", fd);
+		}
+		q.consume(static_cast<size_t>(res));
+		settle(fd, q, engine->drain(fd, q));
+	} catch (const std::exception&) {
+		failed_fds.push_back(fd);
+	}
+}
+#pragma endregion
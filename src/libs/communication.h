@@ -2,28 +2,64 @@
 #define __COMMUNICATION_H__
 
 #define MAX_FRAME_SIZE      		(16 * 1024)
+#define MAX_OUTBOUND_SIZE   		(256 * 1024) // pending bytes per connection before the peer is treated as stalled
+#define RECV_CHUNK          		4096 // minimum free space offered to each recv()
 #define DISCONNECTED_BY_FIN 		500
+#define SEND_OVERFLOW       		501
 
-#include <unordered_set>
-#include <unordered_map>
 #include <vector>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <functional>
 #include <stdexcept>
 
 #include "../libs/socket.h"
 #include "../libs/util.h"
+#include "../libs/connection_tracker.h"
+#include "../libs/io_engine.h"
+#include "../libs/connection_table.h"
+
+typedef std::function<void(std::string_view)> FrameHandler; // the view is only valid during the call
 
 class Communication {
 	private:
-        std::unordered_map<fd_t, std::string> rbuf; // per-connection accumulation buffer
+		// receive and outbound buffers live in the connection's ConnectionTable slot
+		fd_t dispatching; // fd whose frames are being handed out, its buffer must outlive the handler
+		bool dispatch_dropped; // clear_buffer() was requested for it meanwhile
+		bool dispatch_released; // release() was requested for it meanwhile, the slot is handed over afterwards
+		ConnectionTracker* tracker; // arms EPOLLOUT while a queue is blocked on a full socket
+		IoEngine* engine; // owned, writes queued frames out
+		std::vector<fd_t> failed_fds; // writes that failed on completion, handed out by submit()
 	public:
-		~Communication();
+		Communication(ConnectionTracker* tracker = nullptr, IoEngine* engine = nullptr); // takes ownership of engine, SyscallEngine if null
+		virtual ~Communication();
 
-        virtual std::vector<std::string> recv_frame(const fd_t fd); // frame format can be overridden
-        virtual void send_frame(const fd_t fd, const std::string& payload); // frame format can be overridden
-        virtual std::vector<fd_t> broadcast(const std::unordered_set<fd_t>& clients, const std::string& payload);
+        virtual void recv_frame(const fd_t fd, const FrameHandler& on_frame); // frame format can be overridden
+        virtual Frame encode_frame(const std::string& payload); // frame format can be overridden
+        void send_frame(const fd_t fd, const std::string& payload); // encoded in the format of fd's connection
+        void send_encoded(const fd_t fd, const Frame& frame);
+        void send_direct(const fd_t fd, const std::string& payload) noexcept; // best effort, one send() past the queue, for a connection about to be closed
+        virtual std::vector<fd_t> broadcast(const std::vector<fd_t>& clients, const std::string& payload, const std::shared_ptr<void>& keep = nullptr); // encodes once for all clients, every frame holds keep until its last write
+        virtual size_t max_payload() const; // the largest payload any connection can be sent
+        virtual size_t max_payload(const fd_t fd); // ... this connection, in its frame format
 
+		void open(const fd_t fd); // new connection on fd: fresh slot owned by this instance
+		bool claim(const fd_t fd); // take over a connection another instance released, false until it did
+		bool flush(const fd_t fd); // true if nothing is left pending
+		std::vector<fd_t> submit(); // issues the writes prepared this tick, returns connections whose write failed
+		bool release(const fd_t fd); // hand-off: flush, drop buffered bytes and give up the slot, false if bytes were left undelivered
 		void clear_buffer(const fd_t fd);
+	protected:
+		size_t fill(const fd_t fd, RecvBuffer& buf); // one recv() into the free tail, returns bytes read (0 on EAGAIN)
+		virtual Frame encode_for(const fd_t fd, const std::string& payload); // frame format can be chosen per connection
+		static Frame attach(Frame frame, const std::shared_ptr<void>& keep); // same bytes, keep is released with the last copy
+		virtual bool parse_frame(const fd_t fd, RecvBuffer& buf, std::string_view& out); // frame format can be overridden
+	private:
+		void end_dispatch(const fd_t fd, RecvBuffer& buf);
+		bool settle(const fd_t fd, OutQueue& q, const DrainResult r); // (dis)arms EPOLLOUT, true if drained
+		void pump(); // async engines: submit and reap, failures collect in failed_fds
+		void complete(const fd_t fd, const uint64_t tag, const ssize_t res);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,74 @@
+#include <stdexcept>
+
+#include "connection_table.h"
+#include "util.h"
+#include "metrics.h"
+
+std::atomic<Connection*> ConnectionTable::chunks[MAX_CONN_FD >> CONN_CHUNK_BITS];
+std::mutex ConnectionTable::grow_mtx;
+
+Connection& ConnectionTable::at(const fd_t fd) {
+    if (fd < 0 || fd >= MAX_CONN_FD) {
+        throw runtime_errorf("fd %d is out of the connection table.", fd);
+    }
+
+    std::atomic<Connection*>& chunk = chunks[fd >> CONN_CHUNK_BITS];
+    Connection* slots = chunk.load(std::memory_order_acquire);
+    if (!slots) {
+        std::lock_guard<std::mutex> lock(grow_mtx);
+        slots = chunk.load(std::memory_order_relaxed);
+        if (!slots) {
+            slots = new Connection[1 << CONN_CHUNK_BITS];
+            chunk.store(slots, std::memory_order_release);
+        }
+    }
+    return slots[fd & ((1 << CONN_CHUNK_BITS) - 1)];
+}
+
+uint64_t ConnectionTable::key(const fd_t fd) {
+    return (static_cast<uint64_t>(at(fd).gen.load(std::memory_order_acquire)) << 32) | static_cast<uint32_t>(fd);
+}
+
+fd_t ConnectionTable::fd_of(const uint64_t key) {
+    return static_cast<fd_t>(static_cast<uint32_t>(key));
+}
+
+bool ConnectionTable::is_current(const uint64_t key) {
+    return at(fd_of(key)).gen.load(std::memory_order_acquire) == static_cast<uint32_t>(key >> 32);
+}
+
+void ConnectionTable::open(const fd_t fd, const void* owner) {
+    Connection& conn = at(fd);
+    conn.gen.fetch_add(1, std::memory_order_acq_rel);
+    conn.rbuf.head = conn.rbuf.tail = 0;
+    conn.wbuf = OutQueue();
+    conn.frame_mode = 0;
+    conn.member_idx = 0;
+    conn.channel = 0;
+    conn.timer = 0;
+    conn.stats = ConnectionStats();
+    NameTable::release(conn.user.exchange(NO_USER, std::memory_order_acq_rel));
+    conn.owner.store(owner, std::memory_order_release);
+    Metrics::add(M_CONN_OPENED);
+}
+
+void ConnectionTable::close(const fd_t fd) {
+    Connection& conn = at(fd);
+    conn.gen.fetch_add(1, std::memory_order_acq_rel);
+    std::vector<char>().swap(conn.rbuf.data); // idle slots keep no buffer memory
+    conn.rbuf.head = conn.rbuf.tail = 0;
+    conn.wbuf = OutQueue();
+    NameTable::release(conn.user.exchange(NO_USER, std::memory_order_acq_rel));
+    conn.owner.store(nullptr, std::memory_order_release);
+    Metrics::add(M_CONN_CLOSED);
+}
+
+bool ConnectionTable::claim(const fd_t fd, const void* owner) {
+    const void* expected = nullptr;
+    return at(fd).owner.compare_exchange_strong(expected, owner, std::memory_order_acq_rel) || expected == owner;
+}
+
+void ConnectionTable::release(const fd_t fd, const void* owner) {
+    const void* expected = owner;
+    at(fd).owner.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel);
+}
@@ -0,0 +1,71 @@
+#ifndef __CONNECTION_TABLE_H__
+#define __CONNECTION_TABLE_H__
+
+#define CONN_CHUNK_BITS     		10 // 1024 slots per chunk
+#define MAX_CONN_FD         		(1 << 20)
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "socket.h"
+#include "io_engine.h"
+#include "timer_wheel.h"
+#include "name_table.h"
+
+struct RecvBuffer {
+    std::vector<char> data;
+    size_t head = 0; // read cursor, start of the first unparsed byte
+    size_t tail = 0; // end of received bytes
+};
+
+struct ConnectionStats {
+    uint64_t frames_in = 0;
+    uint64_t bytes_in = 0;
+    uint64_t frames_out = 0;
+    uint64_t bytes_out = 0; // handed to the send path, including what is still queued
+};
+
+struct Connection {
+    std::atomic<uint32_t> gen{0}; // bumped on open and close, epoll events carry it to detect reuse
+    std::atomic<const void*> owner{nullptr}; // Communication doing I/O on it, handed over with release()/claim()
+
+    // touched by the owner only
+    RecvBuffer rbuf;
+    OutQueue wbuf;
+    uint8_t frame_mode = 0;
+    uint32_t member_idx = 0; // position in the owning ConnectionTracker
+    uint32_t channel = 0; // 0 while in the lobby
+    timer_id_t timer = 0; // pending timeout in the owner's TimerWheel, e.g. the lobby's join deadline
+    ConnectionStats stats;
+
+    // read across threads
+    std::atomic<user_id_t> user{NO_USER}; // interned name, the slot holds one reference in NameTable
+};
+
+/*
+Per-connection state of the whole process, indexed directly by fd.
+Slots live in fixed chunks that are never moved or freed, so references stay valid while the table grows.
+A slot belongs to one server at a time: the lobby opens it on accept, release()/claim() pass it to a channel and back.
+*/
+
+class ConnectionTable {
+    private:
+        static std::atomic<Connection*> chunks[MAX_CONN_FD >> CONN_CHUNK_BITS];
+        static std::mutex grow_mtx;
+    public:
+        static Connection& at(const fd_t fd); // allocates the chunk on first use, throws if fd is out of range
+
+        static uint64_t key(const fd_t fd); // gen << 32 | fd, stored in epoll_event.data.u64
+        static fd_t fd_of(const uint64_t key);
+        static bool is_current(const uint64_t key); // false once fd was closed (and possibly reused) after key was taken
+
+        static void open(const fd_t fd, const void* owner); // fresh state under a new generation
+        static void close(const fd_t fd); // drops the state, bumps the generation
+        static bool claim(const fd_t fd, const void* owner); // false while the previous owner has not released it
+        static void release(const fd_t fd, const void* owner);
+};
+
+#endif
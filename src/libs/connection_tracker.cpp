@@ -1,8 +1,11 @@
 
 #include <unistd.h>
+#include <cerrno>
 #include "connection_tracker.h"
 
-ConnectionTracker::ConnectionTracker(fd_t& fd, const int max_fd): efd(FD_ERR), listener_fd(fd), max_fd(max_fd) {}
+ConnectionTracker::ConnectionTracker(fd_t& fd, const int max_fd, const bool edge): efd(FD_ERR), listener_fd(fd), max_fd(max_fd), evcnt(0), edge(edge) {
+    client_events = edge ? (EPOLLIN | EPOLLET | EPOLLRDHUP) : EPOLLIN;
+}
 
 ConnectionTracker::~ConnectionTracker() {
     if (efd != FD_ERR) { // cleanup epoll clients
@@ -24,13 +27,15 @@ ConnectionTracker::~ConnectionTracker() {
     clients.clear();
 }
 
-void ConnectionTracker::init() {
+void ConnectionTracker::init(const bool watch_listener) {
     if ((efd = epoll_create1(0)) == FD_ERR) {
         throw std::runtime_error("Failed to create epoll instance.");
     }
+    if (!watch_listener) return;
+
     pollev ev{};
-    ev.events = EPOLLIN;
-    ev.data.fd = listener_fd;
+    ev.events = edge ? (EPOLLIN | EPOLLET) : EPOLLIN;
+    ev.data.u64 = static_cast<uint32_t>(listener_fd); // matched by fd before any generation check
     if (FAILED(epoll_ctl(efd, EPOLL_CTL_ADD, listener_fd, &ev))) {
         throw std::runtime_error("Failed to add listen fd to epoll.");
     }
@@ -39,10 +44,25 @@ void ConnectionTracker::init() {
 
 void ConnectionTracker::polling(const msec to) {
     if (FAILED(evcnt = epoll_wait(efd, events, MAX_PEV, to))) {
+        evcnt = 0;
+        if (errno == EINTR) return; // a signal while blocked, e.g. SIGINT before stop()
         throw std::runtime_error("Failed during polling.");
     }
 }
 
+void ConnectionTracker::watch_internal(const fd_t fd) {
+    if (efd == FD_ERR) {
+        throw std::runtime_error("Epoll instance is not initialized.");
+    }
+
+    pollev ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = static_cast<uint32_t>(fd); // matched by fd like the listener
+    if (FAILED(epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev))) {
+        throw runtime_errorf("Failed to add internal fd %d to epoll.", fd);
+    }
+}
+
 void ConnectionTracker::add_client(const int fd) {
     std::lock_guard<std::mutex> lock(mtx);
     if (fd == FD_ERR) {
@@ -56,13 +76,14 @@ void ConnectionTracker::add_client(const int fd) {
     }
 
     pollev ev{};
-    ev.events = EPOLLIN;
-    ev.data.fd = fd;
+    ev.events = client_events;
+    ev.data.u64 = ConnectionTable::key(fd); // events polled before a close are told apart from the fd's next connection
     if (FAILED(epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev))) {
         throw runtime_errorf("Failed to add fd %d to epoll.", fd);
     }
 
-    clients.insert(fd);
+    ConnectionTable::at(fd).member_idx = static_cast<uint32_t>(clients.size());
+    clients.push_back(fd);
 }
 void ConnectionTracker::delete_client(const int fd) {
     std::lock_guard<std::mutex> lock(mtx);
@@ -76,8 +97,29 @@ void ConnectionTracker::delete_client(const int fd) {
         throw runtime_errorf("Failed to remove fd %d from epoll.", fd);
     }
 
-    if (clients.find(fd) != clients.end())
-        clients.erase(fd);
+    uint32_t idx = ConnectionTable::at(fd).member_idx;
+    if (idx < clients.size() && clients[idx] == fd) { // swap with the last member
+        clients[idx] = clients.back();
+        ConnectionTable::at(clients[idx]).member_idx = idx;
+        clients.pop_back();
+    }
+}
+
+void ConnectionTracker::watch_writable(const int fd, const bool on) {
+    if (efd == FD_ERR) {
+        throw std::runtime_error("Epoll instance is not initialized.");
+    }
+
+    pollev ev{};
+    ev.events = on ? (client_events | EPOLLOUT) : client_events;
+    ev.data.u64 = ConnectionTable::key(fd);
+    if (FAILED(epoll_ctl(efd, EPOLL_CTL_MOD, fd, &ev))) {
+        throw runtime_errorf("Failed to modify fd %d in epoll.", fd);
+    }
+}
+
+fd_t ConnectionTracker::get_efd() const {
+    return efd;
 }
 
 const pollev* ConnectionTracker::get_ev() const {
@@ -88,8 +130,7 @@ const int ConnectionTracker::get_evcnt() const {
     return evcnt;
 }
 
-std::unordered_set<fd_t> ConnectionTracker::get_clients() const {
-    std::lock_guard<std::mutex> lock(mtx);
+const std::vector<fd_t>& ConnectionTracker::get_clients() const {
     return clients;
 }
 
@@ -106,3 +147,7 @@ size_t ConnectionTracker::get_client_count() const {
 	std::lock_guard<std::mutex> lock(mtx);
 	return clients.size();
 }
+
+bool ConnectionTracker::is_edge() const {
+	return edge;
+}
@@ -4,40 +4,47 @@
 #define MAX_PEV        1024
 #define POOL_FULL      601
 
-#include <unordered_set>
+#include <vector>
 #include <sys/epoll.h>
 #include <mutex>
 
 #include "util.h"
 #include "socket.h"
+#include "connection_table.h"
 
 class ConnectionTracker {
     private:
         int max_fd;
         fd_t& listener_fd;
         fd_t efd;
-        std::unordered_set<fd_t> clients;
+        std::vector<fd_t> clients; // dense, a member's position is kept in its ConnectionTable slot
         pollev events[MAX_PEV];
         int evcnt;
         mutable std::mutex mtx;
+        bool edge; // EPOLLET | EPOLLRDHUP: consumers must drain to EAGAIN
+        uint32_t client_events;
 
     public:
-        ConnectionTracker(fd_t& fd, const int max_fd = 256);
+        ConnectionTracker(fd_t& fd, const int max_fd = 256, const bool edge = false);
         ~ConnectionTracker();
 
-        void init();
+        void init(const bool watch_listener = true);
 
         void polling(const msec to);
 
+        void watch_internal(const fd_t fd); // eventfd/timerfd of the polling loop, never a client
         void add_client(const fd_t fd);
         void delete_client(const fd_t fd);
+        void watch_writable(const fd_t fd, const bool on); // EPOLLOUT interest while outbound bytes are pending
 
+        fd_t get_efd() const; // readable while any watched fd has events, can be nested in another epoll set
         const pollev* get_ev() const;
         const int get_evcnt() const;
-        std::unordered_set<fd_t> get_clients() const;
+        const std::vector<fd_t>& get_clients() const; // polling thread only
 		bool is_full() const;
 		int get_max_fd() const;
 		size_t get_client_count() const;
+		bool is_edge() const;
 };
 
 #endif
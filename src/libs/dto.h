@@ -2,8 +2,10 @@
 #define __DTO_H__
 
 #include <string>
+#include <type_traits>
 
 #include "socket.h"
+#include "name_table.h"
 
 typedef unsigned int ch_id_t;
 
@@ -15,8 +17,9 @@ typedef struct {
 	MsgType type;
 	std::string text;
 	msec64 timestamp;
-	std::string user_name;
+	user_id_t user; // not a reference of its own: resolved by render() while the sender's slot still holds the name
 	ch_id_t channel_id;
+	std::string json; // the broadcast object, rendered once by whoever produced the message
 } MessageReqDto;
 
 typedef struct {
@@ -24,11 +27,13 @@ typedef struct {
 	ch_id_t ch_from;
 	ch_id_t ch_to;
 	msec64 timestamp;
-	std::string user_name;
+	user_id_t user;
 } JoinReqDto;
 
+// report payloads travel by value through the report queue: no new/delete, nothing to free when a report is dropped
 typedef union {
-	JoinReqDto* join;
+	JoinReqDto join;
 	// etc...
 } UReportDto;
+static_assert(std::is_trivially_copyable<UReportDto>::value, "report payloads must stay trivially copyable");
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "epoch.h"
+#include "util.h"
+
+std::atomic<uint64_t> Epoch::global{1};
+Epoch::Slot Epoch::slots[EPOCH_MAX_THREADS];
+std::mutex Epoch::retire_mtx;
+std::vector<Epoch::Retired> Epoch::retired;
+
+namespace {
+struct ThreadPin {
+    std::atomic<uint64_t>* active = nullptr;
+    std::atomic<bool>* used = nullptr;
+    unsigned depth = 0; // nested Guards pin once
+
+    ~ThreadPin() {
+        if (!used) return;
+        active->store(0, std::memory_order_release);
+        used->store(false, std::memory_order_release); // the slot goes back with the thread
+    }
+};
+thread_local ThreadPin pin;
+}
+
+Epoch::Guard::Guard() {
+    if (pin.depth++ > 0) return;
+    if (!pin.active) {
+        Slot& slot = self();
+        pin.active = &slot.active;
+        pin.used = &slot.used;
+    }
+    pin.active->store(global.load(std::memory_order_acquire), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst); // published before any shared pointer is loaded
+}
+
+Epoch::Guard::~Guard() {
+    if (--pin.depth > 0) return;
+    pin.active->store(0, std::memory_order_release);
+}
+
+void Epoch::retire(void* ptr, void (*del)(void*)) {
+    std::lock_guard<std::mutex> lock(retire_mtx);
+    // readers pinning from here on load the global epoch after the unlink and cannot reach ptr
+    retired.push_back(Retired{ptr, del, global.fetch_add(1, std::memory_order_acq_rel)});
+    if (retired.size() >= EPOCH_BATCH) reclaim();
+}
+
+size_t Epoch::pending() {
+    std::lock_guard<std::mutex> lock(retire_mtx);
+    return retired.size();
+}
+
+#pragma region PRIVATE_FUNC
+Epoch::Slot& Epoch::self() {
+    for (Slot& slot : slots) {
+        bool expected = false;
+        if (!slot.used.load(std::memory_order_relaxed) && slot.used.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            return slot;
+        }
+    }
+    throw runtime_errorf("More than %d threads read epoch-protected data.", EPOCH_MAX_THREADS);
+}
+
+void Epoch::reclaim() {
+    std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in Guard()
+    uint64_t oldest = UINT64_MAX;
+    for (Slot& slot : slots) {
+        uint64_t e = slot.active.load(std::memory_order_acquire);
+        if (e && e < oldest) oldest = e;
+    }
+
+    size_t kept = 0;
+    for (Retired& r : retired) {
+        if (r.epoch < oldest) {
+            r.del(r.ptr); // nobody pinned when it was still reachable is left
+        } else {
+            retired[kept++] = r;
+        }
+    }
+    retired.resize(kept);
+}
+#pragma endregion
@@ -0,0 +1,58 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#define EPOCH_MAX_THREADS   		256
+#define EPOCH_BATCH         		32 // retired objects collected before a reclamation scan
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+/*
+Epoch-based reclamation (Fraser) for data that readers follow without taking a lock.
+A reader holds a Guard while it touches shared pointers: one store into its own slot, no shared write, wait-free.
+Writers unlink an object first and retire() it afterwards, it is freed once every thread pinned
+at or before the retiring epoch has dropped its Guard.
+*/
+
+class Epoch {
+    private:
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> active{0}; // epoch the owning thread pinned, 0 while outside any Guard
+            std::atomic<bool> used{false};
+        };
+        struct Retired {
+            void* ptr;
+            void (*del)(void*);
+            uint64_t epoch;
+        };
+
+        static std::atomic<uint64_t> global;
+        static Slot slots[EPOCH_MAX_THREADS];
+        static std::mutex retire_mtx;
+        static std::vector<Retired> retired;
+    public:
+        class Guard {
+            public:
+                Guard();
+                ~Guard();
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+        };
+
+        static void retire(void* ptr, void (*del)(void*)); // ptr must be unreachable for new readers already
+        template <typename T>
+        static void retire(T* ptr);
+        static size_t pending(); // retired but not freed yet
+    private:
+        static Slot& self(); // claims a slot for the calling thread on first use, throws if all are taken
+        static void reclaim(); // caller holds retire_mtx
+};
+
+template <typename T>
+void Epoch::retire(T* ptr) {
+    retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+}
+
+#endif
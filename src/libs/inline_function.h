@@ -0,0 +1,90 @@
+#ifndef __INLINE_FUNCTION_H__
+#define __INLINE_FUNCTION_H__
+
+#define INLINE_FN_SIZE      		48 // bytes of captures stored in place, a [this] lambda needs 8
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+/*
+Move-only std::function without the heap: the callable lives in a fixed buffer inside the object,
+so an array of them is one contiguous block and a call is a single indirect jump.
+A callable that does not fit is a compile error, not a silent allocation.
+*/
+
+template <typename Sig, size_t Size = INLINE_FN_SIZE>
+class InlineFunction;
+
+template <typename R, typename... Args, size_t Size>
+class InlineFunction<R(Args...), Size> {
+    private:
+        alignas(std::max_align_t) unsigned char storage[Size];
+        R (*invoke)(void* self, Args&&... args) = nullptr;
+        void (*manage)(void* dst, void* src) = nullptr; // moves src into dst (if any), then destroys src
+    public:
+        InlineFunction() = default;
+
+        template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, InlineFunction>::value>>
+        InlineFunction(F&& func) {
+            typedef std::decay_t<F> T;
+            static_assert(sizeof(T) <= Size, "callable does not fit inline, capture less or raise Size");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "callable is over-aligned");
+            static_assert(std::is_nothrow_move_constructible<T>::value, "callable must be nothrow movable");
+
+            new (storage) T(std::forward<F>(func));
+            invoke = [](void* self, Args&&... args) -> R {
+                return (*std::launder(static_cast<T*>(self)))(std::forward<Args>(args)...);
+            };
+            manage = [](void* dst, void* src) {
+                T* from = std::launder(static_cast<T*>(src));
+                if (dst) new (dst) T(std::move(*from));
+                from->~T();
+            };
+        }
+
+        InlineFunction(InlineFunction&& other) noexcept {
+            take(other);
+        }
+
+        InlineFunction& operator=(InlineFunction&& other) noexcept {
+            if (this != &other) {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+
+        InlineFunction(const InlineFunction&) = delete;
+        InlineFunction& operator=(const InlineFunction&) = delete;
+
+        ~InlineFunction() {
+            reset();
+        }
+
+        R operator()(Args... args) {
+            return invoke(storage, std::forward<Args>(args)...);
+        }
+
+        explicit operator bool() const {
+            return invoke != nullptr;
+        }
+
+        void reset() {
+            if (manage) manage(nullptr, storage);
+            invoke = nullptr;
+            manage = nullptr;
+        }
+    private:
+        void take(InlineFunction& other) {
+            if (!other.manage) return;
+            other.manage(storage, other.storage);
+            invoke = other.invoke;
+            manage = other.manage;
+            other.invoke = nullptr;
+            other.manage = nullptr;
+        }
+};
+
+#endif
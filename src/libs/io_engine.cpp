@@ -0,0 +1,58 @@
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "io_engine.h"
+#include "uring_engine.h"
+#include "util.h"
+
+void OutQueue::consume(size_t n) {
+    bytes -= n;
+    while (n > 0) {
+        OutChunk& c = chunks.front();
+        size_t rest = c.frame->size() - c.off;
+        if (n < rest) {
+            c.off += n;
+            break;
+        }
+        n -= rest;
+        chunks.pop_front();
+    }
+}
+
+bool SyscallEngine::is_async() const {
+    return false;
+}
+
+DrainResult SyscallEngine::drain(const fd_t fd, OutQueue& q) {
+	while (!q.chunks.empty()) {
+		struct iovec iov[MAX_FLUSH_IOV];
+		int cnt = 0;
+		for (auto c = q.chunks.begin(); c != q.chunks.end() && cnt < MAX_FLUSH_IOV; ++c, ++cnt) {
+			iov[cnt].iov_base = const_cast<char*>(c->frame->data() + c->off);
+			iov[cnt].iov_len = c->frame->size() - c->off;
+		}
+
+		struct msghdr msg{};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = cnt;
+		ssize_t n = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return DrainResult::BLOCKED;
+			throw runtime_errorf("Send failed: fd %d", fd);
+		}
+		q.consume(static_cast<size_t>(n));
+	}
+	return DrainResult::DRAINED;
+}
+
+IoEngine* create_io_engine(const bool uring) {
+    if (uring) {
+        try {
+            return new UringEngine();
+        } catch (const std::exception& e) {
+            ERROR("io_uring unavailable, falling back to epoll writes: %s", e.what());
+        }
+    }
+    return new SyscallEngine();
+}
@@ -0,0 +1,61 @@
+#ifndef __IO_ENGINE_H__
+#define __IO_ENGINE_H__
+
+#define MAX_FLUSH_IOV       		64
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "socket.h"
+
+typedef std::shared_ptr<const std::string> Frame; // header + payload, immutable once encoded
+
+struct OutChunk {
+    Frame frame; // shared with every other recipient of the same broadcast
+    size_t off; // bytes of frame already written to the socket
+};
+
+struct OutQueue {
+    std::deque<OutChunk> chunks;
+    size_t bytes = 0; // unsent bytes over all chunks
+    uint64_t inflight = 0; // async engines: tag of the write the kernel still owns, 0 if none
+    bool armed = false; // EPOLLOUT is registered for this connection
+
+    void consume(size_t n); // drop n written bytes from the front
+};
+
+enum class DrainResult {
+    DRAINED,   // queue is empty
+    BLOCKED,   // socket is full, wait for EPOLLOUT
+    IN_FLIGHT  // handed to the kernel, completion arrives through submit()
+};
+
+typedef std::function<void(const fd_t fd, const uint64_t tag, const ssize_t res)> CompletionHandler;
+
+/* Requirement of IoEngine
+- Write Path: move queued frames to sockets. Synchronous engines write inside drain(), asynchronous ones only prepare the write there and issue everything prepared in submit(), once per tick, and leave nothing with the kernel when it returns.
+- Readiness, accept and recv stay with ConnectionTracker's epoll set.
+*/
+
+class IoEngine {
+    public:
+        virtual ~IoEngine() = default;
+
+        virtual bool is_async() const = 0;
+        virtual DrainResult drain(const fd_t fd, OutQueue& q) = 0; // throws on socket errors
+        virtual void submit(const CompletionHandler& on_complete) {}
+};
+
+class SyscallEngine : public IoEngine {
+    public:
+        virtual bool is_async() const override;
+        virtual DrainResult drain(const fd_t fd, OutQueue& q) override; // one sendmsg() per MAX_FLUSH_IOV chunks
+};
+
+IoEngine* create_io_engine(const bool uring); // falls back to SyscallEngine when io_uring is unavailable
+
+#endif
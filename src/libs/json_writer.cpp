@@ -0,0 +1,123 @@
+#include <charconv>
+#include <utility>
+
+#include "json_writer.h"
+
+JsonWriter::JsonWriter(): first(0), depth(0) {}
+
+void JsonWriter::clear() {
+    buf.clear();
+    first = 0;
+    depth = 0;
+}
+
+void JsonWriter::reserve(const size_t bytes) {
+    buf.reserve(bytes);
+}
+
+void JsonWriter::begin_array() {
+    open('[');
+}
+
+void JsonWriter::end_array() {
+    depth--;
+    buf += ']';
+}
+
+void JsonWriter::begin_object() {
+    open('{');
+}
+
+void JsonWriter::end_object() {
+    depth--;
+    buf += '}';
+}
+
+void JsonWriter::key(std::string_view name) {
+    separate();
+    buf += '"';
+    escape(name);
+    buf.append("\": ", 3);
+    first |= 1ull << depth; // the value that follows takes no separator
+}
+
+void JsonWriter::value(std::string_view str) {
+    separate();
+    buf += '"';
+    escape(str);
+    buf += '"';
+}
+
+void JsonWriter::value(const long long num) {
+    separate();
+    char tmp[24];
+    char* end = std::to_chars(tmp, tmp + sizeof(tmp), num).ptr; // same digits as "%lld", without the locale
+    buf.append(tmp, end - tmp);
+}
+
+void JsonWriter::raw(std::string_view json) {
+    separate();
+    buf.append(json.data(), json.size());
+}
+
+const std::string& JsonWriter::str() const {
+    return buf;
+}
+
+size_t JsonWriter::size() const {
+    return buf.size();
+}
+
+std::string JsonWriter::take() {
+    std::string out = std::move(buf);
+    clear();
+    return out;
+}
+
+#pragma region PRIVATE_FUNC
+void JsonWriter::separate() {
+    uint64_t bit = 1ull << depth;
+    if (depth == 0) return;
+    if (first & bit) {
+        first &= ~bit;
+        return;
+    }
+    buf.append(", ", 2);
+}
+
+void JsonWriter::open(const char c) {
+    separate();
+    buf += c;
+    if (depth + 1 < JSON_WRITER_DEPTH) depth++;
+    first |= 1ull << depth;
+}
+
+void JsonWriter::escape(std::string_view str) {
+    const char* run = str.data();
+    const char* end = run + str.size();
+    for (const char* p = run; p < end; p++) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        buf.append(run, p - run);
+        run = p + 1;
+        switch (c) {
+        case '"': buf.append("\\\"", 2); break;
+        case '\\': buf.append("\\\\", 2); break;
+        case '\b': buf.append("\\b", 2); break;
+        case '\f': buf.append("\\f", 2); break;
+        case '\n': buf.append("\\n", 2); break;
+        case '\r': buf.append("\\r", 2); break;
+        case '\t': buf.append("\\t", 2); break;
+        default:
+            {
+                static const char hex[] = "0123456789ABCDEF";
+                char seq[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                buf.append(seq, 6);
+            }
+            break;
+        }
+    }
+    buf.append(run, end - run);
+}
+#pragma endregion
@@ -0,0 +1,47 @@
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#define JSON_WRITER_DEPTH   		64
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+/*
+Appends JSON text into one reusable buffer, byte for byte what json_dumps(root, 0) prints for the same values:
+", " between elements, ": " after keys, members in insertion order, non-ASCII UTF-8 kept as is,
+'"', '\\' and control characters escaped (\uXXXX upper-case for the ones without a short form).
+Strings must be valid UTF-8, check with valid_utf8() first where json_pack() would have refused them.
+*/
+
+class JsonWriter {
+    private:
+        std::string buf;
+        uint64_t first; // bit per open container: nothing written into it yet
+        unsigned depth;
+    public:
+        JsonWriter();
+
+        void clear(); // keeps the capacity
+        void reserve(const size_t bytes);
+
+        void begin_array();
+        void end_array();
+        void begin_object();
+        void end_object();
+
+        void key(std::string_view name);
+        void value(std::string_view str);
+        void value(const long long num);
+        void raw(std::string_view json); // a value rendered earlier, e.g. by another JsonWriter
+
+        const std::string& str() const;
+        size_t size() const;
+        std::string take(); // moves the text out, the writer starts over empty
+    private:
+        void separate(); // ", " unless this is the first element of the current container
+        void open(const char c);
+        void escape(std::string_view str);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include <cmath>
+#include <algorithm>
+
+#include "latency_histogram.h"
+
+#define LAT_SUB_COUNT       		(1u << LAT_SUB_BITS)
+
+LatencyHistogram::LatencyHistogram(): total(0), sum(0), peak(0) {
+    for (std::atomic<uint64_t>& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(const uint64_t ns) {
+    std::atomic<uint64_t>& bucket = buckets[bucket_of(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // single writer
+    total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > peak.load(std::memory_order_relaxed)) peak.store(ns, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return total.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+    return peak.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n ? sum.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::percentile(const double q) const {
+    uint64_t n = count();
+    if (n == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * n));
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LAT_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) return std::min(upper_of(i), max());
+    }
+    return max(); // buckets lag behind total while a record() is under way
+}
+
+uint64_t LatencyHistogram::accumulated() const {
+    return sum.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (unsigned i = 0; i < LAT_BUCKETS; i++) {
+        uint64_t n = other.buckets[i].load(std::memory_order_relaxed);
+        if (n) buckets[i].store(buckets[i].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    total.store(total.load(std::memory_order_relaxed) + other.count(), std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + other.accumulated(), std::memory_order_relaxed);
+    if (other.max() > peak.load(std::memory_order_relaxed)) peak.store(other.max(), std::memory_order_relaxed);
+}
+
+#pragma region PRIVATE_FUNC
+unsigned LatencyHistogram::bucket_of(const uint64_t ns) {
+    uint64_t v = std::min<uint64_t>(ns, (1ull << LAT_MAX_BITS) - 1);
+    if (v < LAT_SUB_COUNT) return static_cast<unsigned>(v); // exact below 16 ns
+    unsigned shift = 63 - __builtin_clzll(v) - LAT_SUB_BITS;
+    return ((shift + 1) << LAT_SUB_BITS) + static_cast<unsigned>((v >> shift) & (LAT_SUB_COUNT - 1));
+}
+
+uint64_t LatencyHistogram::upper_of(const unsigned idx) {
+    if (idx < LAT_SUB_COUNT) return idx;
+    unsigned shift = (idx >> LAT_SUB_BITS) - 1;
+    uint64_t lower = static_cast<uint64_t>(LAT_SUB_COUNT + (idx & (LAT_SUB_COUNT - 1))) << shift;
+    return lower + (1ull << shift) - 1;
+}
+#pragma endregion
@@ -0,0 +1,40 @@
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#define LAT_SUB_BITS        		4 // 16 linear sub-buckets per power of two, values within ~6%
+#define LAT_MAX_BITS        		40 // ~18 minutes in ns, anything longer lands in the last bucket
+#define LAT_BUCKETS         		((LAT_MAX_BITS - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+#include <atomic>
+#include <cstdint>
+
+/*
+Log-linear (HDR-style) histogram of nanosecond durations, fixed size, no allocation after construction.
+Written by one thread at a time without locks or read-modify-writes, any thread may read it meanwhile:
+counters are relaxed atomics, so a reader sees a slightly stale but never torn picture.
+*/
+
+class LatencyHistogram {
+    private:
+        std::atomic<uint64_t> buckets[LAT_BUCKETS];
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> peak;
+    public:
+        LatencyHistogram();
+
+        void record(const uint64_t ns);
+
+        uint64_t count() const;
+        uint64_t max() const;
+        uint64_t mean() const;
+        uint64_t percentile(const double q) const; // q in [0, 1], the bucket's upper bound, never above max()
+        uint64_t accumulated() const; // sum of every recorded value
+
+        void merge(const LatencyHistogram& other); // adds other's counts, as the single writer of this one
+    private:
+        static unsigned bucket_of(const uint64_t ns);
+        static uint64_t upper_of(const unsigned idx);
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+
+#include "message_trace.h"
+
+std::atomic<MessageTrace::Shard*> MessageTrace::shards[TRACE_SHARDS];
+std::atomic<unsigned> MessageTrace::next_shard{0};
+std::mutex MessageTrace::overflow_mtx;
+thread_local MessageTrace::Shard* MessageTrace::local = nullptr;
+
+namespace {
+const char* stage_names[TR_STAGE_COUNT] = {"ingress", "batching", "assembly", "send", "total"}; // parallel to TraceStage
+const double quantiles[] = {0.5, 0.99, 0.999};
+}
+
+MessageTrace::Window::Window(std::vector<Stamps>&& msgs, const uint64_t assembly, const uint64_t handoff): msgs(std::move(msgs)), assembly(assembly), handoff(handoff) {}
+
+MessageTrace::Window::~Window() {
+    if (dropped) return;
+    uint64_t sent = MessageTrace::now();
+    for (const Stamps& msg : msgs) {
+        MessageTrace::record(msg, assembly, handoff, sent);
+    }
+}
+
+void MessageTrace::Window::drop() {
+    dropped = true; // before the dropping thread lets go of its reference, shared_ptr orders it before ~Window
+}
+
+uint64_t MessageTrace::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // vDSO, no syscall
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void MessageTrace::export_timings(JsonWriter& w) {
+    LatencyHistogram stages[TR_STAGE_COUNT];
+    merged(stages);
+    w.begin_object();
+    for (int s = 0; s < TR_STAGE_COUNT; s++) {
+        const LatencyHistogram& h = stages[s];
+        w.key(stage_names[s]);
+        w.begin_object();
+        w.key("count");
+        w.value(static_cast<long long>(h.count()));
+        w.key("p50");
+        w.value(static_cast<long long>(h.percentile(0.5)));
+        w.key("p99");
+        w.value(static_cast<long long>(h.percentile(0.99)));
+        w.key("p999");
+        w.value(static_cast<long long>(h.percentile(0.999)));
+        w.key("max");
+        w.value(static_cast<long long>(h.max()));
+        w.end_object();
+    }
+    w.end_object();
+}
+
+void MessageTrace::render(std::string& out) {
+    LatencyHistogram stages[TR_STAGE_COUNT];
+    if (!merged(stages)) return;
+
+    char line[160];
+    out += "# HELP chat_message_latency_ns Sampled messages, per stage from recv to the last recipient write.\n";
+    out += "# TYPE chat_message_latency_ns summary\n";
+    for (int s = 0; s < TR_STAGE_COUNT; s++) {
+        const LatencyHistogram& h = stages[s];
+        for (const double q : quantiles) {
+            int n = std::snprintf(line, sizeof(line), "chat_message_latency_ns{stage=\"%s\",quantile=\"%g\"} %llu\n", stage_names[s], q, static_cast<unsigned long long>(h.percentile(q)));
+            if (n > 0) out.append(line, std::min<size_t>(static_cast<size_t>(n), sizeof(line) - 1));
+        }
+        int n = std::snprintf(line, sizeof(line), "chat_message_latency_ns_sum{stage=\"%s\"} %llu\nchat_message_latency_ns_count{stage=\"%s\"} %llu\n",
+            stage_names[s], static_cast<unsigned long long>(h.accumulated()), stage_names[s], static_cast<unsigned long long>(h.count()));
+        if (n > 0) out.append(line, std::min<size_t>(static_cast<size_t>(n), sizeof(line) - 1));
+    }
+}
+
+#pragma region PRIVATE_FUNC
+void MessageTrace::record(const Stamps& msg, const uint64_t assembly, const uint64_t handoff, const uint64_t sent) {
+    Shard* shard = local ? local : claim();
+    std::unique_lock<std::mutex> lock(overflow_mtx, std::defer_lock);
+    if (shard == shards[TRACE_SHARDS - 1].load(std::memory_order_relaxed)) lock.lock(); // histograms take one writer at a time
+
+    auto span = [](const uint64_t from, const uint64_t to) { return to > from ? to - from : 0; };
+    shard->stages[TR_INGRESS].record(span(msg.recv, msg.enqueue));
+    shard->stages[TR_BATCHING].record(span(msg.enqueue, assembly));
+    shard->stages[TR_ASSEMBLY].record(span(assembly, handoff));
+    shard->stages[TR_SEND].record(span(handoff, sent));
+    shard->stages[TR_TOTAL].record(span(msg.recv, sent));
+}
+
+MessageTrace::Shard* MessageTrace::claim() {
+    unsigned idx = std::min<unsigned>(next_shard.fetch_add(1, std::memory_order_acq_rel), TRACE_SHARDS - 1);
+    std::lock_guard<std::mutex> lock(overflow_mtx); // only the overflow shard can be claimed twice
+    Shard* shard = shards[idx].load(std::memory_order_relaxed);
+    if (!shard) {
+        shard = new Shard();
+        shards[idx].store(shard, std::memory_order_release);
+    }
+    local = shard;
+    return shard;
+}
+
+bool MessageTrace::merged(LatencyHistogram (&out)[TR_STAGE_COUNT]) {
+    bool any = false;
+    for (unsigned i = 0; i < TRACE_SHARDS; i++) {
+        Shard* shard = shards[i].load(std::memory_order_acquire);
+        if (!shard) continue;
+        any = true;
+        std::unique_lock<std::mutex> lock(overflow_mtx, std::defer_lock);
+        if (i == TRACE_SHARDS - 1) lock.lock(); // shared by several writers, record() holds it too
+        for (int s = 0; s < TR_STAGE_COUNT; s++) out[s].merge(shard->stages[s]);
+    }
+    return any;
+}
+#pragma endregion
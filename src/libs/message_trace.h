@@ -0,0 +1,70 @@
+#ifndef __MESSAGE_TRACE_H__
+#define __MESSAGE_TRACE_H__
+
+#define TRACE_SHARDS        		64 // threads with histograms of their own, later ones share the last under a lock
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "json_writer.h"
+
+/*
+End-to-end latency of sampled messages, split into the stages between five monotonic stamps:
+recv (readiness handled) -> enqueue (taken into a window) -> assembly (window flush starts)
+-> handoff (joined window handed to broadcast) -> sent (the last recipient's frame was written or dropped).
+A traced window rides along with its frames: every frame holds the Window, so its destructor runs when the
+last queued chunk is written out, on whichever thread that happens. Histograms are per thread, merged on read.
+*/
+
+enum TraceStage {
+    TR_INGRESS = 0, // recv -> enqueue: decode, name lookup, render
+    TR_BATCHING, // enqueue -> assembly: waiting for the window to fill or its deadline
+    TR_ASSEMBLY, // assembly -> handoff: sorting and joining the window
+    TR_SEND, // handoff -> sent: frame encoding and socket writes, queued ones included
+    TR_TOTAL, // recv -> sent
+    TR_STAGE_COUNT
+};
+
+class MessageTrace {
+    public:
+        struct Stamps {
+            uint64_t recv;
+            uint64_t enqueue;
+        };
+
+        class Window {
+            private:
+                std::vector<Stamps> msgs;
+                uint64_t assembly;
+                uint64_t handoff;
+                bool dropped = false;
+            public:
+                Window(std::vector<Stamps>&& msgs, const uint64_t assembly, const uint64_t handoff);
+                ~Window(); // the sent stamp, records every message unless dropped
+
+                void drop(); // the window never made it to the sockets, record nothing
+        };
+    private:
+        struct Shard {
+            LatencyHistogram stages[TR_STAGE_COUNT];
+        };
+        static std::atomic<Shard*> shards[TRACE_SHARDS]; // allocated by a thread's first record, never freed
+        static std::atomic<unsigned> next_shard;
+        static std::mutex overflow_mtx; // the last shard is shared
+        static thread_local Shard* local;
+    public:
+        static uint64_t now(); // CLOCK_MONOTONIC in ns
+
+        static void export_timings(JsonWriter& w); // {stage: {count, p50, p99, p999, max}} in ns
+        static void render(std::string& out); // Prometheus summary, nothing until a message was traced
+    private:
+        static void record(const Stamps& msg, const uint64_t assembly, const uint64_t handoff, const uint64_t sent);
+        static Shard* claim();
+        static bool merged(LatencyHistogram (&out)[TR_STAGE_COUNT]); // false if nothing was traced
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "metrics.h"
+
+Metrics::Shard Metrics::shards[METRICS_SHARDS]; // static storage, zeroed before any thread starts
+std::atomic<unsigned> Metrics::next_shard{0};
+thread_local Metrics::Shard* Metrics::local = nullptr;
+
+namespace {
+struct MetricInfo {
+    const char* name;
+    const char* help;
+};
+
+// parallel to MetricCounter
+const MetricInfo counter_info[M_COUNTER_COUNT] = {
+    {"chat_connections_opened_total", "Connections accepted and given a slot."},
+    {"chat_connections_closed_total", "Connections closed by the server or the peer."},
+    {"chat_accept_failed_total", "accept4() errors other than EAGAIN."},
+    {"chat_accept_deferred_total", "Ticks that ran out of accept budget with connections still queued."},
+    {"chat_accept_queue_full_total", "Accept batches that found this process's accept queue at the backlog."},
+    {"chat_frames_in_total", "Frames received."},
+    {"chat_bytes_in_total", "Bytes received, headers included."},
+    {"chat_frames_out_total", "Frames queued for sending, one per recipient."},
+    {"chat_bytes_out_total", "Bytes queued for sending, headers included."},
+    {"chat_messages_in_total", "Chat and system messages taken into a broadcast window."},
+    {"chat_broadcast_windows_total", "Broadcast windows flushed."},
+    {"chat_broadcast_window_messages_total", "Messages carried by flushed windows."},
+    {"chat_send_failed_total", "Recipients dropped because a broadcast could not be sent to them."},
+    {"chat_deletions_total", "fds handed to a deletion pass, including ones already gone."},
+    {"chat_channels_created_total", "Channels created."},
+    {"chat_channels_destroyed_total", "Channels destroyed after running empty."},
+    {"chat_mq_pushed_total", "Messages pushed onto channel queues from other threads."},
+    {"chat_mq_popped_total", "Messages drained from channel queues."},
+    {"chat_reports_pushed_total", "Channel reports accepted by a lobby."},
+    {"chat_reports_popped_total", "Channel reports consumed by a lobby."},
+    {"chat_reports_rejected_total", "Channel reports refused because the lobby queue was full."},
+};
+
+void append_metric(std::string& out, const char* name, const char* help, const char* type, const uint64_t value) {
+    char line[256];
+    int n = std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %llu\n", name, help, name, type, name, static_cast<unsigned long long>(value));
+    if (n > 0) out.append(line, std::min<size_t>(static_cast<size_t>(n), sizeof(line) - 1));
+}
+
+// TcpExt ListenOverflows and ListenDrops, /proc/net/netstat holds a names line and a values line per group
+bool listen_drops(uint64_t& overflows, uint64_t& drops) {
+    std::ifstream in("/proc/net/netstat");
+    std::string names, values;
+    while (std::getline(in, names) && std::getline(in, values)) {
+        if (names.compare(0, 7, "TcpExt:") != 0) continue;
+        std::istringstream ns(names), vs(values);
+        std::string name, value;
+        int found = 0;
+        while (ns >> name && vs >> value) {
+            if (name == "ListenOverflows") {
+                overflows = std::strtoull(value.c_str(), nullptr, 10);
+                found++;
+            } else if (name == "ListenDrops") {
+                drops = std::strtoull(value.c_str(), nullptr, 10);
+                found++;
+            }
+        }
+        return found == 2;
+    }
+    return false;
+}
+}
+
+uint64_t Metrics::total(const MetricCounter c) {
+    uint64_t sum = 0;
+    unsigned used = std::min<unsigned>(next_shard.load(std::memory_order_acquire), METRICS_SHARDS);
+    for (unsigned i = 0; i < used; i++) {
+        sum += shards[i].values[c].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+void Metrics::render(std::string& out) {
+    out.reserve(out.size() + 256 * (M_COUNTER_COUNT + 4));
+    for (int c = 0; c < M_COUNTER_COUNT; c++) {
+        append_metric(out, counter_info[c].name, counter_info[c].help, "counter", total(static_cast<MetricCounter>(c)));
+    }
+    append_metric(out, "chat_connections", "Connections currently open.", "gauge", gauge(M_CONN_OPENED, M_CONN_CLOSED));
+    append_metric(out, "chat_channels", "Channels currently alive.", "gauge", gauge(M_CHANNELS_CREATED, M_CHANNELS_DESTROYED));
+    append_metric(out, "chat_mq_depth", "Messages waiting in channel queues.", "gauge", gauge(M_MQ_PUSHED, M_MQ_POPPED));
+    append_metric(out, "chat_reports_depth", "Channel reports waiting in lobby queues.", "gauge", gauge(M_REPORTS_PUSHED, M_REPORTS_POPPED));
+
+    uint64_t overflows, drops;
+    if (listen_drops(overflows, drops)) { // what the samples miss between batches, but for every listener of the namespace
+        append_metric(out, "chat_listen_overflows_total", "TcpExt ListenOverflows of the network namespace: SYNs or ACKs dropped at a full accept queue.", "counter", overflows);
+        append_metric(out, "chat_listen_drops_total", "TcpExt ListenDrops of the network namespace: overflows plus other listener drops.", "counter", drops);
+    }
+}
+
+#pragma region PRIVATE_FUNC
+Metrics::Shard* Metrics::claim() {
+    unsigned idx = next_shard.fetch_add(1, std::memory_order_acq_rel);
+    local = &shards[std::min<unsigned>(idx, METRICS_SHARDS - 1)]; // the last one is shared, add() uses fetch_add there
+    return local;
+}
+
+uint64_t Metrics::gauge(const MetricCounter up, const MetricCounter down) {
+    uint64_t gone = total(down); // before up, so pushes and pops racing the scrape lean positive
+    uint64_t seen = total(up);
+    return seen > gone ? seen - gone : 0; // relaxed shards may still lag behind each other
+}
+#pragma endregion
@@ -0,0 +1,69 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#define METRICS_SHARDS      		64 // threads with a shard of their own, later ones share the last
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+Process-wide counters, one cache-line aligned shard per thread: add() is a relaxed load and store on a line
+no other thread writes, no lock, no locked instruction, no sharing. Only the overflow shard, shared by the
+threads past METRICS_SHARDS - 1, pays for a fetch_add. Readers sum the shards, a slightly stale total is fine.
+Gauges are the difference of two counters (opened - closed, pushed - popped), so nothing is registered
+per channel or per queue and a scrape never takes a lock either.
+*/
+
+enum MetricCounter {
+    M_CONN_OPENED = 0,
+    M_CONN_CLOSED,
+    M_ACCEPT_FAILED,
+    M_ACCEPT_DEFERRED,
+    M_ACCEPT_QUEUE_FULL,
+    M_FRAMES_IN,
+    M_BYTES_IN,
+    M_FRAMES_OUT,
+    M_BYTES_OUT,
+    M_MESSAGES_IN, // chat messages taken into a window
+    M_WINDOWS, // broadcast windows flushed
+    M_WINDOW_MSGS, // messages carried by them
+    M_SEND_FAILED, // recipients dropped by a broadcast
+    M_DELETIONS,
+    M_CHANNELS_CREATED,
+    M_CHANNELS_DESTROYED,
+    M_MQ_PUSHED,
+    M_MQ_POPPED,
+    M_REPORTS_PUSHED,
+    M_REPORTS_POPPED,
+    M_REPORTS_REJECTED,
+    M_COUNTER_COUNT
+};
+
+class Metrics {
+    private:
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> values[M_COUNTER_COUNT];
+        };
+        static Shard shards[METRICS_SHARDS];
+        static std::atomic<unsigned> next_shard;
+        static thread_local Shard* local;
+    public:
+        static void add(const MetricCounter c, const uint64_t n = 1) {
+            Shard* shard = local ? local : claim();
+            std::atomic<uint64_t>& v = shard->values[c];
+            if (shard == &shards[METRICS_SHARDS - 1]) {
+                v.fetch_add(n, std::memory_order_relaxed); // overflow shard, shared
+            } else {
+                v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); // single writer, no locked op
+            }
+        }
+        static uint64_t total(const MetricCounter c);
+
+        static void render(std::string& out); // Prometheus text exposition format 0.0.4, plus the kernel's listen drop counters
+    private:
+        static Shard* claim(); // a thread's first add(), kept until exit, its counts outlive it
+        static uint64_t gauge(const MetricCounter up, const MetricCounter down);
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include <functional>
+
+#include "name_table.h"
+#include "util.h"
+
+#define NAME_IDX_MASK       		((1u << NAME_IDX_BITS) - 1)
+#define NAME_INDEX_MIN      		64
+
+std::atomic<NameTable::Entry*> NameTable::chunks[(1 << NAME_IDX_BITS) >> NAME_CHUNK_BITS];
+std::atomic<NameTable::Index*> NameTable::index{nullptr};
+NameTable::Record NameTable::tomb{NO_USER, 0, std::string()};
+std::vector<uint32_t> NameTable::free_idx;
+uint32_t NameTable::next_idx = 1;
+std::atomic<size_t> NameTable::live{0};
+std::mutex NameTable::mtx;
+
+user_id_t NameTable::intern(std::string_view name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Record* found = lookup(name);
+    if (found) {
+        found->refs++;
+        return found->id;
+    }
+
+    uint32_t idx;
+    if (!free_idx.empty()) {
+        idx = free_idx.back();
+        free_idx.pop_back();
+    } else {
+        if (next_idx > NAME_IDX_MASK) {
+            throw runtime_errorf("Too many user names (%u).", next_idx - 1);
+        }
+        idx = next_idx++;
+    }
+    Entry& e = entry(idx);
+    Record* rec = new Record{(e.gen << NAME_IDX_BITS) | idx, 1, std::string(name)};
+    e.rec.store(rec, std::memory_order_release);
+    index_insert(rec);
+    live.fetch_add(1, std::memory_order_relaxed);
+    return rec->id;
+}
+
+void NameTable::release(const user_id_t id) {
+    if (id == NO_USER) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    Record* rec = record(id);
+    if (!rec || --rec->refs > 0) return;
+
+    uint32_t idx = id & NAME_IDX_MASK;
+    Entry& e = entry(idx);
+    e.rec.store(nullptr, std::memory_order_release);
+    index_erase(rec);
+    e.gen = (e.gen + 1) & (UINT32_MAX >> NAME_IDX_BITS); // index 0 is never handed out, so ids stay non-zero
+    free_idx.push_back(idx);
+    live.fetch_sub(1, std::memory_order_relaxed);
+    Epoch::retire(rec); // readers that loaded it before the unlink may still be printing it
+}
+
+user_id_t NameTable::find(std::string_view name) {
+    Epoch::Guard guard;
+    Record* rec = lookup(name);
+    return rec ? rec->id : NO_USER;
+}
+
+bool NameTable::resolve(const user_id_t id, std::string& out) {
+    return with_name(id, [&out](std::string_view name) { out.assign(name.data(), name.size()); });
+}
+
+size_t NameTable::size() {
+    return live.load(std::memory_order_relaxed);
+}
+
+#pragma region PRIVATE_FUNC
+NameTable::Record* NameTable::record(const user_id_t id) {
+    uint32_t idx = id & NAME_IDX_MASK;
+    if (idx == 0) return nullptr;
+    Entry* chunk = chunks[idx >> NAME_CHUNK_BITS].load(std::memory_order_acquire);
+    if (!chunk) return nullptr;
+    Record* rec = chunk[idx & ((1 << NAME_CHUNK_BITS) - 1)].rec.load(std::memory_order_acquire);
+    if (!rec || rec->id != id) return nullptr;
+    return rec;
+}
+
+NameTable::Record* NameTable::lookup(std::string_view name) {
+    Index* ix = index.load(std::memory_order_acquire);
+    if (!ix) return nullptr;
+    for (size_t i = std::hash<std::string_view>()(name) & ix->mask;; i = (i + 1) & ix->mask) {
+        Record* rec = ix->buckets[i].load(std::memory_order_acquire);
+        if (!rec) return nullptr; // never full, some bucket is empty
+        if (rec != &tomb && rec->name == name) return rec;
+    }
+}
+
+NameTable::Entry& NameTable::entry(const uint32_t idx) {
+    std::atomic<Entry*>& chunk = chunks[idx >> NAME_CHUNK_BITS];
+    Entry* slots = chunk.load(std::memory_order_relaxed);
+    if (!slots) {
+        slots = new Entry[1 << NAME_CHUNK_BITS];
+        chunk.store(slots, std::memory_order_release);
+    }
+    return slots[idx & ((1 << NAME_CHUNK_BITS) - 1)];
+}
+
+void NameTable::index_insert(Record* rec) {
+    Index* ix = index.load(std::memory_order_relaxed);
+    if (!ix || (ix->used + 1) * 2 > ix->mask + 1) {
+        // rebuilt without tombstones at a quarter full, readers keep probing the old one until they drop their Guard
+        size_t cap = NAME_INDEX_MIN;
+        while (cap < (live.load(std::memory_order_relaxed) + 1) * 4) cap <<= 1;
+        Index* next = new Index{cap - 1, 0, std::unique_ptr<std::atomic<Record*>[]>(new std::atomic<Record*>[cap])};
+        for (size_t i = 0; i < cap; i++) next->buckets[i].store(nullptr, std::memory_order_relaxed);
+        if (ix) {
+            for (size_t i = 0; i <= ix->mask; i++) {
+                Record* old = ix->buckets[i].load(std::memory_order_relaxed);
+                if (!old || old == &tomb) continue;
+                size_t j = std::hash<std::string_view>()(old->name) & next->mask;
+                while (next->buckets[j].load(std::memory_order_relaxed)) j = (j + 1) & next->mask;
+                next->buckets[j].store(old, std::memory_order_relaxed);
+                next->used++;
+            }
+        }
+        index.store(next, std::memory_order_release);
+        if (ix) Epoch::retire(ix);
+        ix = next;
+    }
+
+    // the first free bucket on the probe path, a reader looking for rec stops at the first empty one after it
+    size_t i = std::hash<std::string_view>()(rec->name) & ix->mask;
+    Record* cur;
+    while ((cur = ix->buckets[i].load(std::memory_order_relaxed)) && cur != &tomb) i = (i + 1) & ix->mask;
+    if (!cur) ix->used++;
+    ix->buckets[i].store(rec, std::memory_order_release);
+}
+
+void NameTable::index_erase(Record* rec) {
+    Index* ix = index.load(std::memory_order_relaxed);
+    for (size_t i = std::hash<std::string_view>()(rec->name) & ix->mask;; i = (i + 1) & ix->mask) {
+        Record* cur = ix->buckets[i].load(std::memory_order_relaxed);
+        if (!cur) return;
+        if (cur == rec) {
+            ix->buckets[i].store(&tomb, std::memory_order_release);
+            return;
+        }
+    }
+}
+#pragma endregion
@@ -0,0 +1,80 @@
+#ifndef __NAME_TABLE_H__
+#define __NAME_TABLE_H__
+
+#define NAME_IDX_BITS       		20 // low bits of user_id_t, the rest is the entry's generation
+#define NAME_CHUNK_BITS     		10 // 1024 entries per chunk
+#define NO_USER             		0
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "epoch.h"
+
+typedef uint32_t user_id_t; // NO_USER is never a live name
+
+/*
+Interned user names of the whole process. Equal names share one record, the bytes are stored once
+and live as long as someone holds a reference, normally the connection slots that carry the id.
+Ids carry the entry's generation: a stale id resolves to nothing, never to a name interned later in the same entry.
+
+Readers never lock: records are immutable once published, id and name lookups are a few atomic loads under an
+Epoch::Guard, and records or index tables that writers replace are freed through Epoch::retire().
+Writers (intern/release) serialize on mtx and never wait for readers.
+*/
+
+class NameTable {
+    private:
+        struct Record {
+            user_id_t id;
+            uint32_t refs; // writers only
+            std::string name;
+        };
+        struct Entry {
+            std::atomic<Record*> rec{nullptr};
+            uint32_t gen = 0; // writers only, bumped when the record is dropped
+        };
+        struct Index { // open addressing by name, linear probing, at most half full including tombstones
+            size_t mask;
+            size_t used;
+            std::unique_ptr<std::atomic<Record*>[]> buckets;
+        };
+
+        static std::atomic<Entry*> chunks[(1 << NAME_IDX_BITS) >> NAME_CHUNK_BITS]; // never moved or freed, index 0 unused
+        static std::atomic<Index*> index;
+        static Record tomb; // marks an erased bucket, probing goes on past it
+        static std::vector<uint32_t> free_idx;
+        static uint32_t next_idx;
+        static std::atomic<size_t> live;
+        static std::mutex mtx; // writers only
+    public:
+        static user_id_t intern(std::string_view name); // with one reference for the caller
+        static void release(const user_id_t id); // the last one drops the record, NO_USER is ignored
+
+        static user_id_t find(std::string_view name); // NO_USER if nobody holds that name, wait-free
+        static bool resolve(const user_id_t id, std::string& out);
+        template <typename F>
+        static bool with_name(const user_id_t id, F&& fn); // fn(std::string_view) while the record is pinned, wait-free
+        static size_t size(); // live records
+    private:
+        static Record* record(const user_id_t id); // nullptr if stale, caller holds a Guard or mtx
+        static Record* lookup(std::string_view name); // same
+        static Entry& entry(const uint32_t idx); // allocates the chunk, caller holds mtx
+        static void index_insert(Record* rec);
+        static void index_erase(Record* rec);
+};
+
+template <typename F>
+bool NameTable::with_name(const user_id_t id, F&& fn) {
+    Epoch::Guard guard;
+    Record* rec = record(id);
+    if (!rec) return false;
+    fn(std::string_view(rec->name));
+    return true;
+}
+
+#endif
@@ -1,35 +1,60 @@
 #ifndef __PRODUCER_CONSUMER_H__
 #define __PRODUCER_CONSUMER_H__
 
+#define MPSC_NODE_BLOCK     		64 // nodes in an unbounded MPSC queue's first block, every later block doubles
+#define MPSC_NODE_BLOCKS    		25 // MPSC_NODE_BLOCK * (2^25 - 1) nodes at most, node indices stay below MPSC_NO_NODE
+#define MPSC_NO_NODE        		UINT32_MAX
+
 #include <queue>
+#include <vector>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <condition_variable>
+#include <functional>
+#include <cstdint>
 
 /* FULLY GENERATED BY AI */
 
+enum QueueBackend {
+    QUEUE_LOCKED, // std::queue under a mutex, any number of consumers
+    QUEUE_MPSC // lock-free, many producers and exactly one consumer thread
+};
+
+enum QueueOverflow {
+    OVERFLOW_REJECT, // push() returns false while the queue holds Capacity items
+    OVERFLOW_BLOCK // push() waits for room, returns false only once stop() was called
+};
+
 /*
 Thread-safe Producer-Consumer Queue
 Integrates synchronization logic (mutex, condition_variable) into a single class.
+Capacity 0 is unbounded, any other Capacity bounds the queue and Overflow says what push() does when it is full.
 */
-template <typename T>
+template <typename T, QueueBackend Backend = QUEUE_LOCKED, size_t Capacity = 0, QueueOverflow Overflow = OVERFLOW_REJECT>
 class ProducerConsumerQueue {
 private:
     std::queue<T> queue_;
     mutable std::mutex mutex_;
     std::condition_variable cond_;
+    std::condition_variable not_full_; // bounded OVERFLOW_BLOCK only
     bool stopped_ = false;
+    std::function<void()> notifier_; // called by push() when the queue turns non-empty, e.g. to signal an eventfd
 
 public:
     ProducerConsumerQueue() = default;
-    
+
     // 복사 방지 (동기화 객체는 복사 불가)
     ProducerConsumerQueue(const ProducerConsumerQueue&) = delete;
     ProducerConsumerQueue& operator=(const ProducerConsumerQueue&) = delete;
 
     ~ProducerConsumerQueue();
 
-    // Producer: 데이터 추가
-    void push(T item);
+    // Producer: 데이터 추가. 용량 초과(OVERFLOW_REJECT) 또는 stop() 이후 대기 중이면 false
+    bool push(T item);
+
+    // Consumer가 condition_variable 대신 epoll 등으로 대기할 때 사용. push 전에 설정
+    void set_notifier(std::function<void()> notifier);
 
     // Consumer: 데이터 꺼내기 (Blocking)
     // 큐에 데이터가 들어올 때까지 대기합니다.
@@ -41,8 +66,8 @@ public:
     bool try_pop(T& out_item);
 
     // Consumer: 모든 데이터 꺼내기 (Batch Processing)
-    // 락을 한 번만 걸고 큐의 모든 내용을 가져옵니다. (Swap 방식)
-    std::queue<T> pop_all();
+    // 락을 한 번만 걸고 큐의 모든 내용을 out 뒤에 옮깁니다. out의 용량은 재사용됩니다. 꺼낸 개수를 반환
+    size_t pop_all(std::vector<T>& out);
 
     // 상태 확인
     bool empty() const;
@@ -53,5 +78,81 @@ public:
     void stop();
 };
 
+/*
+Lock-free multi-producer single-consumer queue with the same interface.
+Unbounded (Capacity 0): Vyukov's intrusive MPSC list, push() is one exchange plus a node off a lock-free freelist
+the consumer refills. Nodes come in blocks owned by the queue, so a burst keeps its nodes until the queue is destroyed.
+Bounded: Vyukov's ring of sequenced cells, Capacity must be a power of two, nothing is allocated after construction.
+With OVERFLOW_BLOCK a producer that finds the ring full parks on a condition variable the consumer signals once it
+has freed cells, the way wait_and_pop() parks the consumer.
+try_pop(), wait_and_pop() and pop_all() must only be called from one consumer thread at a time.
+*/
+template <typename T, size_t Capacity, QueueOverflow Overflow>
+class ProducerConsumerQueue<T, QUEUE_MPSC, Capacity, Overflow> {
+private:
+    static_assert(Capacity == 0 || (Capacity & (Capacity - 1)) == 0, "bounded MPSC capacity must be a power of two");
+
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        std::atomic<uint32_t> free_next{MPSC_NO_NODE}; // index of the next free node while this one is free
+        uint32_t idx = 0;
+        alignas(T) unsigned char value[sizeof(T)]; // constructed while queued, the stub holds none
+    };
+    struct Cell {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char value[sizeof(T)];
+    };
+
+    // unbounded
+    alignas(64) std::atomic<Node*> head_; // producers exchange the newest node in
+    alignas(64) Node* tail_; // consumer only, stub before the oldest item
+    alignas(64) std::atomic<uint64_t> free_{MPSC_NO_NODE}; // generation << 32 | index of the top free node, the generation defeats ABA
+    std::atomic<Node*> blocks_[MPSC_NODE_BLOCKS] = {}; // block k holds MPSC_NODE_BLOCK << k nodes
+    std::atomic<unsigned> block_count_{0};
+
+    // bounded
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) size_t dequeue_pos_ = 0; // consumer only
+
+    alignas(64) std::atomic<size_t> count_{0}; // items pushed and not yet popped
+    std::atomic<bool> stopped_{false};
+    alignas(64) std::atomic<bool> signaled_{false}; // notifier_ ran and the consumer has not looked since
+    std::atomic<bool> waiting_{false}; // the consumer sleeps in wait_and_pop()
+    std::atomic<unsigned> full_waiters_{0}; // bounded OVERFLOW_BLOCK: producers parked on not_full_
+    std::mutex wait_mutex_;
+    std::condition_variable cond_;
+    std::condition_variable not_full_;
+    std::function<void()> notifier_;
+
+public:
+    ProducerConsumerQueue();
+
+    ProducerConsumerQueue(const ProducerConsumerQueue&) = delete;
+    ProducerConsumerQueue& operator=(const ProducerConsumerQueue&) = delete;
+
+    ~ProducerConsumerQueue();
+
+    bool push(T item);
+    void set_notifier(std::function<void()> notifier); // before the first push, it is read without a lock
+    bool wait_and_pop(T& out_item);
+    bool try_pop(T& out_item);
+    size_t pop_all(std::vector<T>& out);
+    bool empty() const; // a snapshot, items may be in flight
+    size_t size() const;
+    void stop();
+
+private:
+    void disarm(); // the consumer is about to look, the next push has to notify
+    T* front(); // oldest item if its push is complete
+    void pop_front(); // destroys front()
+    void wake_producers(); // after freeing cells, only takes wait_mutex_ if a producer is parked
+    bool wait_not_full(const size_t pos); // parks until the cell for pos is free, false once stopped
+    Node* acquire_node(); // any thread
+    void release_node(Node* node); // consumer only
+    Node* grow(); // allocates the next block, keeps its first node and frees the rest
+    Node* node_at(const uint32_t idx) const;
+};
+
 #include "producer_consumer.tpp"
-#endif
\ No newline at end of file
+#endif
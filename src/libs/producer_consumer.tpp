@@ -1,25 +1,47 @@
+#include <new>
 
 #include "producer_consumer.h"
 
-template <typename T>
-ProducerConsumerQueue<T>::~ProducerConsumerQueue() {
+#define PCQ_TEMPLATE template <typename T, QueueBackend Backend, size_t Capacity, QueueOverflow Overflow>
+#define PCQ ProducerConsumerQueue<T, Backend, Capacity, Overflow>
+#define MPSC_TEMPLATE template <typename T, size_t Capacity, QueueOverflow Overflow>
+#define MPSC ProducerConsumerQueue<T, QUEUE_MPSC, Capacity, Overflow>
+
+#pragma region QUEUE_LOCKED
+PCQ_TEMPLATE
+PCQ::~ProducerConsumerQueue() {
 	stop();
 	while (!queue_.empty()) {
 		queue_.pop();
 	}
 }
 
-template <typename T>
-void ProducerConsumerQueue<T>::push(T item) {
+PCQ_TEMPLATE
+bool PCQ::push(T item) {
+	bool was_empty;
 	{
-		std::lock_guard<std::mutex> lock(mutex_);
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (Capacity > 0 && queue_.size() >= Capacity) {
+			if (Overflow == OVERFLOW_REJECT) return false;
+			not_full_.wait(lock, [this]() { return stopped_ || queue_.size() < Capacity; });
+			if (stopped_) return false;
+		}
+		was_empty = queue_.empty();
 		queue_.push(std::move(item));
 	}
 	cond_.notify_one();
+	if (was_empty && notifier_) notifier_(); // the consumer drains everything at once, one signal per batch
+	return true;
 }
 
-template <typename T>
-bool ProducerConsumerQueue<T>::wait_and_pop(T& out_item) {
+PCQ_TEMPLATE
+void PCQ::set_notifier(std::function<void()> notifier) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	notifier_ = std::move(notifier);
+}
+
+PCQ_TEMPLATE
+bool PCQ::wait_and_pop(T& out_item) {
 	std::unique_lock<std::mutex> lock(mutex_);
 	cond_.wait(lock, [this]() { return stopped_ || !queue_.empty(); });
 	if (stopped_ && queue_.empty()) {
@@ -27,45 +49,293 @@ bool ProducerConsumerQueue<T>::wait_and_pop(T& out_item) {
 	}
 	out_item = std::move(queue_.front());
 	queue_.pop();
+	if (Capacity > 0) not_full_.notify_one();
 	return true;
 }
 
-template <typename T>
-bool ProducerConsumerQueue<T>::try_pop(T& out_item) {
+PCQ_TEMPLATE
+bool PCQ::try_pop(T& out_item) {
 	std::lock_guard<std::mutex> lock(mutex_);
 	if (queue_.empty()) {
 		return false;
 	}
 	out_item = std::move(queue_.front());
 	queue_.pop();
+	if (Capacity > 0) not_full_.notify_one();
 	return true;
 }
 
-template <typename T>
-std::queue<T> ProducerConsumerQueue<T>::pop_all() {
+PCQ_TEMPLATE
+size_t PCQ::pop_all(std::vector<T>& out) {
 	std::lock_guard<std::mutex> lock(mutex_);
-	std::queue<T> local_q;
-	std::swap(queue_, local_q);
-	return local_q;
+	size_t n = queue_.size();
+	while (!queue_.empty()) {
+		out.push_back(std::move(queue_.front()));
+		queue_.pop();
+	}
+	if (Capacity > 0 && n) not_full_.notify_all();
+	return n;
 }
 
-template <typename T>
-bool ProducerConsumerQueue<T>::empty() const {
+PCQ_TEMPLATE
+bool PCQ::empty() const {
 	std::lock_guard<std::mutex> lock(mutex_);
 	return queue_.empty();
 }
 
-template <typename T>
-size_t ProducerConsumerQueue<T>::size() const {
+PCQ_TEMPLATE
+size_t PCQ::size() const {
 	std::lock_guard<std::mutex> lock(mutex_);
 	return queue_.size();
 }
 
-template <typename T>
-void ProducerConsumerQueue<T>::stop() {
+PCQ_TEMPLATE
+void PCQ::stop() {
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
 		stopped_ = true;
 	}
 	cond_.notify_all();
-}
\ No newline at end of file
+	not_full_.notify_all();
+}
+#pragma endregion
+
+#pragma region QUEUE_MPSC
+MPSC_TEMPLATE
+MPSC::ProducerConsumerQueue() {
+	if constexpr (Capacity == 0) {
+		tail_ = acquire_node();
+		head_.store(tail_, std::memory_order_relaxed);
+	} else {
+		cells_.reset(new Cell[Capacity]);
+		for (size_t i = 0; i < Capacity; i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+	}
+}
+
+MPSC_TEMPLATE
+MPSC::~ProducerConsumerQueue() {
+	stop();
+	while (front()) pop_front();
+	if constexpr (Capacity == 0) {
+		for (unsigned k = 0; k < MPSC_NODE_BLOCKS; k++) delete[] blocks_[k].load(std::memory_order_relaxed);
+	}
+}
+
+MPSC_TEMPLATE
+bool MPSC::push(T item) {
+	if constexpr (Capacity == 0) {
+		Node* node = acquire_node();
+		node->next.store(nullptr, std::memory_order_relaxed);
+		new (node->value) T(std::move(item));
+		count_.fetch_add(1, std::memory_order_relaxed);
+		Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release); // until here the consumer sees the list end at prev
+	} else {
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &cells_[pos & (Capacity - 1)];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (dif == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (dif < 0) { // full, the consumer has not freed this lap's cell yet
+				if (Overflow == OVERFLOW_REJECT || !wait_not_full(pos)) return false;
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			} else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		new (cell->value) T(std::move(item));
+		count_.fetch_add(1, std::memory_order_relaxed);
+		cell->seq.store(pos + 1, std::memory_order_release);
+	}
+
+	std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fences in disarm() and wait_and_pop()
+	if (notifier_ && !signaled_.load(std::memory_order_relaxed) && !signaled_.exchange(true, std::memory_order_acq_rel)) {
+		notifier_(); // first push since the consumer last found the queue drained, one signal per batch
+	}
+	if (waiting_.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(wait_mutex_);
+		cond_.notify_one();
+	}
+	return true;
+}
+
+MPSC_TEMPLATE
+void MPSC::set_notifier(std::function<void()> notifier) {
+	notifier_ = std::move(notifier);
+}
+
+MPSC_TEMPLATE
+bool MPSC::wait_and_pop(T& out_item) {
+	for (;;) {
+		if (try_pop(out_item)) return true;
+		if (stopped_.load(std::memory_order_acquire)) return false;
+
+		std::unique_lock<std::mutex> lock(wait_mutex_);
+		waiting_.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		cond_.wait(lock, [this]() { return count_.load(std::memory_order_acquire) > 0 || stopped_.load(std::memory_order_acquire); });
+		waiting_.store(false, std::memory_order_relaxed);
+	}
+}
+
+MPSC_TEMPLATE
+bool MPSC::try_pop(T& out_item) {
+	T* item = front();
+	if (!item) {
+		if (!notifier_) return false;
+		disarm();
+		if (!(item = front())) return false;
+	}
+	out_item = std::move(*item);
+	pop_front();
+	count_.fetch_sub(1, std::memory_order_relaxed);
+	wake_producers();
+	return true;
+}
+
+MPSC_TEMPLATE
+size_t MPSC::pop_all(std::vector<T>& out) {
+	if (notifier_) disarm(); // without a notifier an empty poll stays a plain load
+	size_t n = 0;
+	size_t expected = count_.load(std::memory_order_relaxed);
+	if (expected == 0) return 0;
+	out.reserve(out.size() + expected);
+	while (T* item = front()) {
+		out.push_back(std::move(*item));
+		pop_front();
+		n++;
+	}
+	count_.fetch_sub(n, std::memory_order_relaxed);
+	wake_producers(); // once per batch, not per cell
+	return n;
+}
+
+MPSC_TEMPLATE
+bool MPSC::empty() const {
+	return count_.load(std::memory_order_acquire) == 0;
+}
+
+MPSC_TEMPLATE
+size_t MPSC::size() const {
+	return count_.load(std::memory_order_acquire);
+}
+
+MPSC_TEMPLATE
+void MPSC::stop() {
+	stopped_.store(true, std::memory_order_release);
+	std::lock_guard<std::mutex> lock(wait_mutex_);
+	cond_.notify_all();
+	not_full_.notify_all();
+}
+
+MPSC_TEMPLATE
+void MPSC::disarm() {
+	// items published from here on signal again, including one stuck behind a producer that was preempted mid-push
+	signaled_.exchange(false, std::memory_order_acq_rel);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+MPSC_TEMPLATE
+T* MPSC::front() {
+	if constexpr (Capacity == 0) {
+		Node* next = tail_->next.load(std::memory_order_acquire);
+		return next ? std::launder(reinterpret_cast<T*>(next->value)) : nullptr;
+	} else {
+		Cell& cell = cells_[dequeue_pos_ & (Capacity - 1)];
+		if (cell.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) return nullptr;
+		return std::launder(reinterpret_cast<T*>(cell.value));
+	}
+}
+
+MPSC_TEMPLATE
+void MPSC::pop_front() {
+	front()->~T();
+	if constexpr (Capacity == 0) {
+		Node* tail = tail_;
+		tail_ = tail->next.load(std::memory_order_relaxed); // becomes the stub
+		release_node(tail); // its producer stored next before we could see it, nobody touches it any more
+	} else {
+		cells_[dequeue_pos_ & (Capacity - 1)].seq.store(dequeue_pos_ + Capacity, std::memory_order_release); // free for the next lap
+		dequeue_pos_++;
+	}
+}
+
+MPSC_TEMPLATE
+void MPSC::wake_producers() {
+	if constexpr (Capacity > 0 && Overflow == OVERFLOW_BLOCK) {
+		std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the one in wait_not_full()
+		if (full_waiters_.load(std::memory_order_relaxed) == 0) return;
+		std::lock_guard<std::mutex> lock(wait_mutex_);
+		not_full_.notify_all(); // each waits for its own cell
+	}
+}
+
+MPSC_TEMPLATE
+bool MPSC::wait_not_full(const size_t pos) {
+	Cell& cell = cells_[pos & (Capacity - 1)];
+	std::unique_lock<std::mutex> lock(wait_mutex_);
+	full_waiters_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst); // the consumer either sees the waiter or we see the freed cell
+	not_full_.wait(lock, [&]() {
+		return static_cast<intptr_t>(cell.seq.load(std::memory_order_acquire) - pos) >= 0 || stopped_.load(std::memory_order_acquire);
+	});
+	full_waiters_.fetch_sub(1, std::memory_order_relaxed);
+	return !stopped_.load(std::memory_order_acquire);
+}
+
+MPSC_TEMPLATE
+typename MPSC::Node* MPSC::acquire_node() {
+	uint64_t top = free_.load(std::memory_order_acquire);
+	for (;;) {
+		uint32_t idx = static_cast<uint32_t>(top);
+		if (idx == MPSC_NO_NODE) return grow();
+		Node* node = node_at(idx);
+		// free_next may be stale if another producer took the node meanwhile, the generation fails the exchange then
+		uint64_t next = (((top >> 32) + 1) << 32) | node->free_next.load(std::memory_order_relaxed);
+		if (free_.compare_exchange_weak(top, next, std::memory_order_acquire, std::memory_order_acquire)) return node;
+	}
+}
+
+MPSC_TEMPLATE
+void MPSC::release_node(Node* node) {
+	uint64_t top = free_.load(std::memory_order_relaxed);
+	do {
+		node->free_next.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+	} while (!free_.compare_exchange_weak(top, (((top >> 32) + 1) << 32) | node->idx, std::memory_order_release, std::memory_order_relaxed));
+}
+
+MPSC_TEMPLATE
+typename MPSC::Node* MPSC::grow() {
+	unsigned k = block_count_.fetch_add(1, std::memory_order_relaxed); // producers that race here each get a block
+	if (k >= MPSC_NODE_BLOCKS) throw std::bad_alloc();
+	size_t n = static_cast<size_t>(MPSC_NODE_BLOCK) << k;
+	uint32_t first = MPSC_NODE_BLOCK * ((1u << k) - 1);
+	Node* block = new Node[n];
+	for (size_t i = 0; i < n; i++) {
+		block[i].idx = first + static_cast<uint32_t>(i);
+		block[i].free_next.store(first + static_cast<uint32_t>(i) + 1, std::memory_order_relaxed);
+	}
+	blocks_[k].store(block, std::memory_order_release);
+
+	// block[1..n-1] is already linked, it goes on the freelist in one exchange
+	uint64_t top = free_.load(std::memory_order_relaxed);
+	do {
+		block[n - 1].free_next.store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+	} while (!free_.compare_exchange_weak(top, (((top >> 32) + 1) << 32) | block[1].idx, std::memory_order_release, std::memory_order_relaxed));
+	return &block[0];
+}
+
+MPSC_TEMPLATE
+typename MPSC::Node* MPSC::node_at(const uint32_t idx) const {
+	unsigned k = 63 - __builtin_clzll(idx / MPSC_NODE_BLOCK + 1); // block k starts at MPSC_NODE_BLOCK * (2^k - 1)
+	return &blocks_[k].load(std::memory_order_acquire)[idx - MPSC_NODE_BLOCK * ((1u << k) - 1)];
+}
+#pragma endregion
+
+#undef PCQ_TEMPLATE
+#undef PCQ
+#undef MPSC_TEMPLATE
+#undef MPSC
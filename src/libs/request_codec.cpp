@@ -0,0 +1,242 @@
+#include <cstring>
+
+#include "request_codec.h"
+
+static void append_utf8(std::string& out, const uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+static WireRequest::Kind kind_of(std::string_view type) {
+    if (type == "join" || type == "Join" || type == "JOIN") return WireRequest::JOIN;
+    if (type == "message" || type == "Message" || type == "MESSAGE") return WireRequest::MESSAGE;
+    return WireRequest::UNKNOWN;
+}
+
+namespace {
+// every read fails the whole decode instead of guessing, jansson then has the final say
+struct Cursor {
+    const char* p;
+    const char* end;
+    std::string& scratch;
+
+    void skip_ws() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    bool expect(const char c) {
+        skip_ws();
+        if (p >= end || *p != c) return false;
+        p++;
+        return true;
+    }
+
+    bool hex4(uint32_t& out) {
+        if (end - p < 4) return false;
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            int v = hex_value(p[i]);
+            if (v < 0) return false;
+            out = (out << 4) | static_cast<uint32_t>(v);
+        }
+        p += 4;
+        return true;
+    }
+
+    // p is just past the opening quote
+    bool string(std::string_view& out, const bool allow_escapes) {
+        const char* start = p;
+        bool high = false;
+        while (p < end && *p != '"' && *p != '\\') {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c < 0x20) return false;
+            high |= c >= 0x80;
+            p++;
+        }
+        if (p >= end) return false;
+        if (high && !valid_utf8(start, p - start)) return false;
+        if (*p == '"') {
+            out = std::string_view(start, p - start);
+            p++;
+            return true;
+        }
+        if (!allow_escapes) return false;
+
+        // reserved for the whole frame up front, views taken earlier stay valid
+        size_t at = scratch.size();
+        scratch.append(start, p - start);
+        while (p < end && *p != '"') {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c < 0x20) return false;
+            if (c != '\\') {
+                const char* run = p;
+                while (p < end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20) p++;
+                if (!valid_utf8(run, p - run)) return false;
+                scratch.append(run, p - run);
+                continue;
+            }
+            if (++p >= end) return false;
+            switch (*p++) {
+            case '"': scratch += '"'; break;
+            case '\\': scratch += '\\'; break;
+            case '/': scratch += '/'; break;
+            case 'b': scratch += '\b'; break;
+            case 'f': scratch += '\f'; break;
+            case 'n': scratch += '\n'; break;
+            case 'r': scratch += '\r'; break;
+            case 't': scratch += '\t'; break;
+            case 'u':
+                {
+                    uint32_t cp;
+                    if (!hex4(cp) || cp == 0) return false; // jansson refuses NUL without JSON_ALLOW_NUL
+                    if (cp >= 0xDC00 && cp <= 0xDFFF) return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        uint32_t lo;
+                        if (end - p < 2 || p[0] != '\\' || p[1] != 'u') return false;
+                        p += 2;
+                        if (!hex4(lo) || lo < 0xDC00 || lo > 0xDFFF) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    append_utf8(scratch, cp);
+                }
+                break;
+            default:
+                return false;
+            }
+        }
+        if (p >= end) return false;
+        p++;
+        out = std::string_view(scratch.data() + at, scratch.size() - at);
+        return true;
+    }
+
+    // integers only: reals are rare here and jansson knows which ones overflow
+    bool integer(long long& out) {
+        bool neg = false;
+        if (p < end && *p == '-') { neg = true; p++; }
+        if (p >= end || *p < '0' || *p > '9') return false;
+        if (*p == '0' && p + 1 < end && p[1] >= '0' && p[1] <= '9') return false;
+
+        unsigned long long v = 0;
+        bool overflow = false;
+        while (p < end && *p >= '0' && *p <= '9') {
+            unsigned d = *p - '0';
+            if (v > (static_cast<unsigned long long>(INT64_MAX) + (neg ? 1 : 0) - d) / 10) overflow = true;
+            v = v * 10 + d;
+            p++;
+        }
+        if (overflow || (p < end && (*p == '.' || *p == 'e' || *p == 'E'))) return false;
+        out = neg ? static_cast<long long>(0 - v) : static_cast<long long>(v);
+        return true;
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if (static_cast<size_t>(end - p) < n || memcmp(p, word, n) != 0) return false;
+        p += n;
+        return true;
+    }
+};
+}
+
+bool RequestDecoder::decode(std::string_view frame, WireRequest& out) {
+    scratch.clear();
+    if (scratch.capacity() < frame.size()) scratch.reserve(frame.size());
+    Cursor cur{frame.data(), frame.data() + frame.size(), scratch};
+    out = WireRequest();
+
+    if (!cur.expect('{')) return false;
+    cur.skip_ws();
+    if (cur.p < cur.end && *cur.p == '}') return false; // no type, let jansson report it
+    bool has_type = false;
+    for (;;) {
+        std::string_view key;
+        if (!cur.expect('"') || !cur.string(key, false) || !cur.expect(':')) return false;
+        cur.skip_ws();
+        if (cur.p >= cur.end) return false;
+
+        unsigned bit = key == "channel_id" ? REQ_CHANNEL_ID : key == "timestamp" ? REQ_TIMESTAMP
+            : key == "user_name" ? REQ_USER_NAME : key == "text" ? REQ_TEXT : 0;
+        bool is_type = key == "type";
+        if (bit || is_type) out.fields &= ~bit; // duplicate keys: the last one wins, as in jansson
+
+        char c = *cur.p;
+        if (c == '"') {
+            cur.p++;
+            std::string_view value;
+            if (!cur.string(value, true)) return false;
+            if (is_type) {
+                out.kind = kind_of(value);
+                has_type = true;
+            } else if (bit == REQ_USER_NAME) {
+                out.user_name = value;
+                out.fields |= bit;
+            } else if (bit == REQ_TEXT) {
+                out.text = value;
+                out.fields |= bit;
+            }
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            long long value = 0;
+            if (!cur.integer(value) || is_type) return false;
+            if (bit == REQ_CHANNEL_ID) {
+                out.channel_id = static_cast<ch_id_t>(value);
+                out.fields |= bit;
+            } else if (bit == REQ_TIMESTAMP) {
+                out.timestamp = static_cast<msec64>(value);
+                out.fields |= bit;
+            }
+        } else if (cur.literal("true") || cur.literal("false") || cur.literal("null")) {
+            if (is_type) return false;
+        } else {
+            return false; // nested containers are left to jansson
+        }
+
+        cur.skip_ws();
+        if (cur.p >= cur.end) return false;
+        if (*cur.p == ',') { cur.p++; continue; }
+        if (*cur.p == '}') { cur.p++; break; }
+        return false;
+    }
+    cur.skip_ws();
+    return cur.p == cur.end && has_type && out.kind != WireRequest::UNKNOWN;
+}
+
+bool RequestDecoder::from_json(json_t* root, WireRequest& out) {
+    out = WireRequest();
+    json_t* type = json_object_get(root, "type");
+    if (!json_is_string(type)) return false;
+    out.kind = kind_of(std::string_view(json_string_value(type), json_string_length(type)));
+    if (out.kind == WireRequest::UNKNOWN) return false;
+
+    json_t* v;
+    if (json_is_integer(v = json_object_get(root, "channel_id"))) {
+        out.channel_id = static_cast<ch_id_t>(json_integer_value(v));
+        out.fields |= REQ_CHANNEL_ID;
+    }
+    if (json_is_integer(v = json_object_get(root, "timestamp"))) {
+        out.timestamp = static_cast<msec64>(json_integer_value(v));
+        out.fields |= REQ_TIMESTAMP;
+    }
+    if (json_is_string(v = json_object_get(root, "user_name"))) {
+        out.user_name = std::string_view(json_string_value(v), json_string_length(v));
+        out.fields |= REQ_USER_NAME;
+    }
+    if (json_is_string(v = json_object_get(root, "text"))) {
+        out.text = std::string_view(json_string_value(v), json_string_length(v));
+        out.fields |= REQ_TEXT;
+    }
+    return true;
+}
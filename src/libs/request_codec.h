@@ -0,0 +1,40 @@
+#ifndef __REQUEST_CODEC_H__
+#define __REQUEST_CODEC_H__
+
+#define REQ_CHANNEL_ID      (1u << 0)
+#define REQ_TIMESTAMP       (1u << 1)
+#define REQ_USER_NAME       (1u << 2)
+#define REQ_TEXT            (1u << 3)
+
+#include <string>
+#include <string_view>
+
+#include "json.h"
+#include "dto.h"
+
+struct WireRequest {
+    enum Kind { UNKNOWN, JOIN, MESSAGE } kind = UNKNOWN;
+    unsigned fields = 0; // REQ_* present with the expected JSON type
+    ch_id_t channel_id = 0;
+    msec64 timestamp = 0;
+    std::string_view user_name; // into the frame, the decoder's scratch or the DOM; valid while the hook runs
+    std::string_view text;
+
+    bool has(const unsigned mask) const { return (fields & mask) == mask; }
+};
+
+/*
+Decoder for the request shapes clients actually send: a flat object with "type" join/message and scalar members.
+It reads the frame in place, strings without escapes are views into it and escaped ones share one reused buffer.
+Anything else (other types, nested values, input jansson would reject) returns false and goes through jansson.
+*/
+
+class RequestDecoder {
+    private:
+        std::string scratch; // unescaped strings of the current frame, capacity kept across frames
+    public:
+        bool decode(std::string_view frame, WireRequest& out);
+        static bool from_json(json_t* root, WireRequest& out); // the same shapes from a parsed DOM
+};
+
+#endif
@@ -7,53 +7,90 @@
 #include <stdexcept>
 #include <iterator>
 #include <mutex>
+#include <atomic>
 #include <chrono>
 
 #include "util.h"
+#include "inline_function.h"
+#include "producer_consumer.h"
+#include "latency_histogram.h"
+
+/*
+Runs its sessions in order once per run(), each session a list of tasks, once-tasks are dropped after their call.
+Until freeze() every call takes mtx, run() included, so tasks may be pushed and popped from anywhere at any time.
+freeze() fixes the pipeline: the tasks are laid out in one contiguous array of InlineFunctions and run() takes no lock.
+Afterwards only once-tasks can be added, they go through a lock-free queue and run at their session's turn in the next run().
+With set_timing(true) before freeze(), every named task and every session records its duration per run() into a
+LatencyHistogram, one clock read per task. Without it run() reads no clock at all.
+*/
 
 template <typename Fn>
 class TaskRunner {
     private:
         struct Task {
             bool once;
-            std::function<Fn> func;
+            InlineFunction<Fn> func;
+            const char* name; // string literal or nullptr
+        };
+        struct OnceTask {
+            unsigned int session;
+            bool front;
+            InlineFunction<Fn> func;
         };
         std::vector<std::deque<Task>> tasks;
+        std::vector<const char*> session_names;
+        bool timing = false;
         mutable std::mutex mtx;
+
+        // frozen pipeline, touched by the running thread only
+        std::atomic<bool> frozen{false};
+        std::vector<InlineFunction<Fn>> pipeline; // every session's tasks back to back
+        std::vector<size_t> session_end; // pipeline offset past each session
+        std::vector<std::vector<InlineFunction<Fn>>> once_front, once_back; // per session, collected from once_q
+        std::vector<InlineFunction<Fn>> running; // once-tasks being called, so a throwing one is not retried
+        std::vector<OnceTask> once_batch;
+        ProducerConsumerQueue<OnceTask, QUEUE_MPSC> once_q;
+        std::vector<const char*> task_names; // parallel to pipeline
+        std::unique_ptr<LatencyHistogram[]> task_hist; // parallel to pipeline, only with timing
+        std::unique_ptr<LatencyHistogram[]> session_hist; // per session, once-tasks included
     public:
         ~TaskRunner() = default;
         
-        void push_oncef(const unsigned int which, const std::function<Fn>& func);
-        void push_onceb(const unsigned int which, const std::function<Fn>& func);
+        template <typename F>
+        void push_oncef(const unsigned int which, F&& func);
+        template <typename F>
+        void push_onceb(const unsigned int which, F&& func);
 
-        void pushf(const unsigned int which, const std::function<Fn>& func);
-        void pushb(const unsigned int which, const std::function<Fn>& func);
+        template <typename F>
+        void pushf(const unsigned int which, F&& func, const char* name = nullptr); // throws once frozen
+        template <typename F>
+        void pushb(const unsigned int which, F&& func, const char* name = nullptr); // throws once frozen
 
-        void popf(const unsigned int which);
-        void popb(const unsigned int which);
+        void popf(const unsigned int which); // throws once frozen
+        void popb(const unsigned int which); // throws once frozen
 
-        void new_session(const unsigned int cnt);
+        void new_session(const unsigned int cnt); // throws once frozen
+        void name_session(const unsigned int which, const char* name); // throws once frozen
+        void set_timing(const bool on); // takes effect at freeze()
+
+        void freeze(); // from the thread that will call run(), before other threads push once-tasks
+        bool is_frozen() const;
         
         void run();
+
+        // visit(session name, task name or nullptr for the session as a whole, histogram), any thread, nothing before freeze()
+        template <typename Visit>
+        void for_each_timing(Visit&& visit) const;
     private:
         std::deque<Task>& session_at(unsigned int idx);
-        void _pushb(std::deque<Task>& session, bool flag, const std::function<Fn>& func);
-        void _pushf(std::deque<Task>& session, bool flag, const std::function<Fn>& func);
+        void run_frozen();
+        void run_timed();
+        void collect_once();
+        void run_once(std::vector<InlineFunction<Fn>>& list, const bool reverse);
 
         template <typename Op>
         void exec_locked(unsigned int idx, Op&& op);
 };
 
-// It is recommended to use universal ref-perfect forwarding when making wrapper.
-template <typename Callable>
-auto AsThrottle(Callable&& func, msec64 timeout) {
-    return [func = std::forward<Callable>(func), timeout, last = msec64(0)]() mutable {
-        msec64 now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-        if (now - last < timeout) return;
-        last = now;
-        func();
-    };
-}
-
 #include "task_runner.tpp"
 #endif
@@ -4,25 +4,42 @@ template <typename Fn>
 template <typename Op>
 void TaskRunner<Fn>::exec_locked(unsigned int idx, Op&& op) {
     std::lock_guard<std::mutex> lock(mtx);
+    if (frozen.load(std::memory_order_relaxed)) {
+        throw std::runtime_error("Task pipeline is frozen.");
+    }
     op(session_at(idx));
 }
 
 template <typename Fn>
-void TaskRunner<Fn>::push_oncef(const unsigned int which, const std::function<Fn>& func) {
-    exec_locked(which, [&](auto& session) { _pushf(session, true, func); });
+template <typename F>
+void TaskRunner<Fn>::push_oncef(const unsigned int which, F&& func) {
+    if (frozen.load(std::memory_order_acquire)) {
+        if (which >= session_end.size()) throw std::runtime_error("Task session out of range.");
+        once_q.push(OnceTask{which, true, InlineFunction<Fn>(std::forward<F>(func))});
+        return;
+    }
+    exec_locked(which, [&](auto& session) { session.push_front(Task{true, InlineFunction<Fn>(std::forward<F>(func)), nullptr}); });
 }
 template <typename Fn>
-void TaskRunner<Fn>::push_onceb(const unsigned int which, const std::function<Fn>& func) {
-    exec_locked(which, [&](auto& session) { _pushb(session, true, func); });
+template <typename F>
+void TaskRunner<Fn>::push_onceb(const unsigned int which, F&& func) {
+    if (frozen.load(std::memory_order_acquire)) {
+        if (which >= session_end.size()) throw std::runtime_error("Task session out of range.");
+        once_q.push(OnceTask{which, false, InlineFunction<Fn>(std::forward<F>(func))});
+        return;
+    }
+    exec_locked(which, [&](auto& session) { session.push_back(Task{true, InlineFunction<Fn>(std::forward<F>(func)), nullptr}); });
 }
 
 template <typename Fn>
-void TaskRunner<Fn>::pushf(const unsigned int which, const std::function<Fn>& func) {
-    exec_locked(which, [&](auto& session) { _pushf(session, false, func); });
+template <typename F>
+void TaskRunner<Fn>::pushf(const unsigned int which, F&& func, const char* name) {
+    exec_locked(which, [&](auto& session) { session.push_front(Task{false, InlineFunction<Fn>(std::forward<F>(func)), name}); });
 }
 template <typename Fn>
-void TaskRunner<Fn>::pushb(const unsigned int which, const std::function<Fn>& func) {
-    exec_locked(which, [&](auto& session) { _pushb(session, false, func); });
+template <typename F>
+void TaskRunner<Fn>::pushb(const unsigned int which, F&& func, const char* name) {
+    exec_locked(which, [&](auto& session) { session.push_back(Task{false, InlineFunction<Fn>(std::forward<F>(func)), name}); });
 }
 
 template <typename Fn>
@@ -37,13 +54,81 @@ void TaskRunner<Fn>::popb(const unsigned int which) {
 template <typename Fn>
 void TaskRunner<Fn>::new_session(const unsigned int cnt) {
     std::lock_guard<std::mutex> lock(mtx);
+    if (frozen.load(std::memory_order_relaxed)) {
+        throw std::runtime_error("Task pipeline is frozen.");
+    }
     for (unsigned int i = 0; i < cnt; i++) {
         tasks.emplace_back();
+        session_names.push_back(nullptr);
+    }
+}
+
+template <typename Fn>
+void TaskRunner<Fn>::name_session(const unsigned int which, const char* name) {
+    exec_locked(which, [&](auto&) { session_names[which] = name; });
+}
+
+template <typename Fn>
+void TaskRunner<Fn>::set_timing(const bool on) {
+    std::lock_guard<std::mutex> lock(mtx);
+    timing = on;
+}
+
+template <typename Fn>
+void TaskRunner<Fn>::freeze() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (frozen.load(std::memory_order_relaxed)) return;
+
+    size_t total = 0;
+    for (auto& session : tasks) total += session.size();
+    pipeline.reserve(total);
+    task_names.reserve(total);
+    session_end.reserve(tasks.size());
+    once_front.resize(tasks.size());
+    once_back.resize(tasks.size());
+    for (unsigned int s = 0; s < tasks.size(); s++) {
+        for (Task& task : tasks[s]) {
+            if (task.once) {
+                once_back[s].push_back(std::move(task.func)); // still runs exactly once, in its session
+            } else {
+                pipeline.push_back(std::move(task.func));
+                task_names.push_back(task.name);
+            }
+        }
+        session_end.push_back(pipeline.size());
+    }
+    tasks.clear();
+    if (timing) {
+        task_hist.reset(new LatencyHistogram[pipeline.size()]);
+        session_hist.reset(new LatencyHistogram[session_end.size()]);
+    }
+    frozen.store(true, std::memory_order_release);
+}
+
+template <typename Fn>
+bool TaskRunner<Fn>::is_frozen() const {
+    return frozen.load(std::memory_order_acquire);
+}
+
+template <typename Fn>
+template <typename Visit>
+void TaskRunner<Fn>::for_each_timing(Visit&& visit) const {
+    if (!frozen.load(std::memory_order_acquire) || !session_hist) return;
+    size_t i = 0;
+    for (size_t s = 0; s < session_end.size(); s++) {
+        visit(session_names[s], static_cast<const char*>(nullptr), session_hist[s]);
+        for (; i < session_end[s]; i++) {
+            if (task_names[i]) visit(session_names[s], task_names[i], task_hist[i]);
+        }
     }
 }
 
 template <typename Fn>
 void TaskRunner<Fn>::run() {
+    if (frozen.load(std::memory_order_acquire)) {
+        run_frozen();
+        return;
+    }
     std::lock_guard<std::mutex> lock(mtx);
     for (auto& session : tasks) {
         for (auto it = session.begin(); it != session.end();) {
@@ -61,11 +146,70 @@ std::deque<typename TaskRunner<Fn>::Task>& TaskRunner<Fn>::session_at(unsigned i
     }
     return tasks[idx];
 }
+
 template <typename Fn>
-void TaskRunner<Fn>::_pushb(std::deque<Task>& session, bool flag, const std::function<Fn>& func) {
-    session.push_back({flag, func});
+void TaskRunner<Fn>::run_frozen() {
+    if (session_hist) {
+        run_timed();
+        return;
+    }
+    collect_once();
+
+    InlineFunction<Fn>* task = pipeline.data();
+    for (size_t s = 0; s < session_end.size(); s++) {
+        if (!once_front[s].empty()) run_once(once_front[s], true);
+        for (InlineFunction<Fn>* end = pipeline.data() + session_end[s]; task != end; task++) {
+            (*task)();
+        }
+        if (!once_back[s].empty()) run_once(once_back[s], false);
+    }
 }
+
 template <typename Fn>
-void TaskRunner<Fn>::_pushf(std::deque<Task>& session, bool flag, const std::function<Fn>& func) {
-    session.push_front({flag, func});
+void TaskRunner<Fn>::run_timed() {
+    typedef std::chrono::steady_clock clock; // clock_gettime(CLOCK_MONOTONIC) through the vDSO
+    collect_once();
+
+    clock::time_point mark = clock::now();
+    size_t i = 0;
+    for (size_t s = 0; s < session_end.size(); s++) {
+        clock::time_point session_start = mark;
+        if (!once_front[s].empty()) {
+            run_once(once_front[s], true);
+            mark = clock::now();
+        }
+        for (; i < session_end[s]; i++) {
+            pipeline[i]();
+            clock::time_point done = clock::now(); // the end of one task is the start of the next
+            task_hist[i].record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - mark).count());
+            mark = done;
+        }
+        if (!once_back[s].empty()) {
+            run_once(once_back[s], false);
+            mark = clock::now();
+        }
+        session_hist[s].record(std::chrono::duration_cast<std::chrono::nanoseconds>(mark - session_start).count());
+    }
+}
+
+template <typename Fn>
+void TaskRunner<Fn>::collect_once() {
+    if (!once_q.pop_all(once_batch)) return;
+    for (OnceTask& task : once_batch) {
+        (task.front ? once_front : once_back)[task.session].push_back(std::move(task.func));
+    }
+    once_batch.clear();
+}
+
+template <typename Fn>
+void TaskRunner<Fn>::run_once(std::vector<InlineFunction<Fn>>& list, const bool reverse) {
+    running.clear(); // what a throwing task left behind is dropped, not retried
+    running.swap(list);
+    if (reverse) { // pushed to the front: the last one pushed runs first
+        for (size_t i = running.size(); i-- > 0;) running[i]();
+    } else {
+        for (InlineFunction<Fn>& func : running) func();
+    }
+    running.clear();
 }
+#pragma endregion
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include "timer_wheel.h"
+
+#define NIL_NODE            		UINT32_MAX
+
+TimerWheel::TimerWheel(const msec tick): armed(0), tick_ms(tick > 0 ? tick : 1), origin(now_ms()), current(0) {
+    nodes.resize(WHEEL_LEVELS * WHEEL_SLOTS + 1);
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        nodes[i].prev = nodes[i].next = i;
+        nodes[i].gen = 0;
+        nodes[i].expires = 0;
+    }
+}
+
+timer_id_t TimerWheel::arm(const msec delay, std::function<void()> cb) {
+    uint32_t idx;
+    if (!free_nodes.empty()) {
+        idx = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        idx = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(Node{NIL_NODE, NIL_NODE, 0, 0, nullptr});
+    }
+
+    uint64_t ticks = delay > 0 ? (static_cast<uint64_t>(delay) + tick_ms - 1) / tick_ms : 0;
+    uint64_t base = std::max(current, (now_ms() - origin) / tick_ms); // current lags while the loop sleeps
+    Node& node = nodes[idx];
+    node.expires = base + std::max<uint64_t>(ticks, 1);
+    node.cb = std::move(cb);
+    place(idx);
+    armed++;
+    return (static_cast<uint64_t>(node.gen) << 32) | idx;
+}
+
+bool TimerWheel::cancel(const timer_id_t id) {
+    uint32_t idx = static_cast<uint32_t>(id);
+    if (id == 0 || idx <= firing_head() || idx >= nodes.size()) return false;
+    Node& node = nodes[idx];
+    if (node.gen != static_cast<uint32_t>(id >> 32) || node.prev == NIL_NODE) return false;
+
+    unlink(idx);
+    release_node(idx);
+    armed--;
+    return true;
+}
+
+size_t TimerWheel::advance() {
+    uint64_t target = (now_ms() - origin) / tick_ms;
+    size_t fired = 0;
+    while (current < target) {
+        if (armed == 0) { // nothing to cascade or fire, jump straight to now
+            current = target;
+            break;
+        }
+        current++;
+        for (unsigned level = 1; level < WHEEL_LEVELS; level++) {
+            if (current & ((1ull << (WHEEL_BITS * level)) - 1)) break;
+            cascade(level);
+        }
+        fired += fire_slot();
+    }
+    return fired;
+}
+
+msec64 TimerWheel::next_deadline() const {
+    if (armed == 0) return 0;
+
+    // level 0 is exact; past its end a cascade may bring timers down, wake up for it
+    uint64_t due = (current | (WHEEL_SLOTS - 1)) + 1;
+    for (uint64_t t = current + 1; t < due; t++) {
+        uint32_t head = static_cast<uint32_t>(t & (WHEEL_SLOTS - 1));
+        if (nodes[head].next != head) {
+            due = t;
+            break;
+        }
+    }
+
+    return origin + due * tick_ms;
+}
+
+msec TimerWheel::next_timeout() const {
+    msec64 at = next_deadline();
+    if (at == 0) return -1;
+    msec64 now = now_ms();
+    return at > now ? static_cast<msec>(at - now) : 0;
+}
+
+size_t TimerWheel::size() const {
+    return armed;
+}
+
+msec64 TimerWheel::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#pragma region PRIVATE_FUNC
+uint32_t TimerWheel::firing_head() const {
+    return WHEEL_LEVELS * WHEEL_SLOTS;
+}
+
+void TimerWheel::link(const uint32_t head, const uint32_t idx) {
+    Node& node = nodes[idx];
+    node.prev = nodes[head].prev;
+    node.next = head;
+    nodes[node.prev].next = idx;
+    nodes[head].prev = idx;
+}
+
+void TimerWheel::unlink(const uint32_t idx) {
+    Node& node = nodes[idx];
+    nodes[node.prev].next = node.next;
+    nodes[node.next].prev = node.prev;
+    node.prev = node.next = NIL_NODE;
+}
+
+void TimerWheel::place(const uint32_t idx) {
+    Node& node = nodes[idx];
+    if (node.expires < current) node.expires = current;
+
+    // the lowest level whose next-level block still holds both now and the expiry
+    for (unsigned level = 0; level < WHEEL_LEVELS; level++) {
+        if ((node.expires >> (WHEEL_BITS * (level + 1))) == (current >> (WHEEL_BITS * (level + 1)))) {
+            link(level * WHEEL_SLOTS + ((node.expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)), idx);
+            return;
+        }
+    }
+
+    // beyond the top level: park in the top slot cascaded last and re-place from there
+    const unsigned top = WHEEL_LEVELS - 1;
+    link(top * WHEEL_SLOTS + (((current >> (WHEEL_BITS * top)) - 1) & (WHEEL_SLOTS - 1)), idx);
+}
+
+void TimerWheel::cascade(const unsigned level) {
+    uint32_t head = level * WHEEL_SLOTS + ((current >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+    while (nodes[head].next != head) {
+        uint32_t idx = nodes[head].next;
+        unlink(idx);
+        place(idx); // always lands below level, or in another top slot
+    }
+}
+
+size_t TimerWheel::fire_slot() {
+    // detach the slot first: callbacks may arm new timers into it or cancel ones still waiting to fire
+    uint32_t slot = static_cast<uint32_t>(current & (WHEEL_SLOTS - 1)), fhead = firing_head();
+    while (nodes[slot].next != slot) {
+        uint32_t idx = nodes[slot].next;
+        unlink(idx);
+        link(fhead, idx);
+    }
+
+    size_t fired = 0;
+    while (nodes[fhead].next != fhead) {
+        uint32_t idx = nodes[fhead].next;
+        unlink(idx);
+        std::function<void()> cb = std::move(nodes[idx].cb);
+        release_node(idx);
+        armed--;
+        fired++;
+        if (cb) cb();
+    }
+    return fired;
+}
+
+void TimerWheel::release_node(const uint32_t idx) {
+    Node& node = nodes[idx];
+    node.gen++;
+    node.cb = nullptr;
+    free_nodes.push_back(idx);
+}
+#pragma endregion
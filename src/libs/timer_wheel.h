@@ -0,0 +1,59 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#define WHEEL_BITS          		6 // 64 slots per level
+#define WHEEL_SLOTS         		(1u << WHEEL_BITS)
+#define WHEEL_LEVELS        		4 // 2^24 ticks, ~46 hours at 10 ms
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "util.h"
+
+typedef uint64_t timer_id_t; // 0 is never a live timer
+
+/*
+Hierarchical timing wheel (Varghese & Lauck). Timers hang in intrusive lists so arm() and cancel() are O(1),
+a tick only touches the slot that expires and, every 64^n ticks, one slot of level n that is cascaded down.
+Not thread-safe: a wheel belongs to the loop that advances it, callbacks run inside advance().
+*/
+
+class TimerWheel {
+    private:
+        struct Node {
+            uint32_t prev, next; // indices into nodes, slot heads are sentinel nodes
+            uint32_t gen; // bumped on every release, stale ids fail to cancel
+            uint64_t expires; // absolute tick
+            std::function<void()> cb;
+        };
+
+        std::vector<Node> nodes; // [0, WHEEL_LEVELS * WHEEL_SLOTS) slot heads, then the firing list head, then timers
+        std::vector<uint32_t> free_nodes;
+        size_t armed;
+
+        msec tick_ms;
+        msec64 origin; // steady clock at tick 0
+        uint64_t current; // last tick processed
+    public:
+        TimerWheel(const msec tick = 10);
+
+        timer_id_t arm(const msec delay, std::function<void()> cb);
+        bool cancel(const timer_id_t id); // false if it already fired or was cancelled
+        size_t advance(); // fires everything due by now, returns the number fired
+        msec64 next_deadline() const; // steady ms of the next tick that may fire, 0 if nothing is armed
+        msec next_timeout() const; // ms until next_deadline(), -1 if nothing is armed
+        size_t size() const;
+
+        static msec64 now_ms(); // steady clock
+    private:
+        uint32_t firing_head() const;
+        void link(const uint32_t head, const uint32_t idx);
+        void unlink(const uint32_t idx);
+        void place(const uint32_t idx);
+        void cascade(const unsigned level);
+        size_t fire_slot();
+        void release_node(const uint32_t idx);
+};
+
+#endif
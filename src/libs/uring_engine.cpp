@@ -0,0 +1,212 @@
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring_engine.h"
+#include "util.h"
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+namespace {
+thread_local std::unique_ptr<UringRing> thread_ring;
+thread_local bool thread_ring_failed = false; // not retried on every tick
+}
+
+UringRing::UringRing(const unsigned entries): ring_fd(FD_ERR), sq_ptr(MAP_FAILED), sq_size(0), cq_ptr(MAP_FAILED), cq_size(0), sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), sqes_size(0), entries(0) {
+    io_uring_params p{};
+    ring_fd = io_uring_setup(entries, &p);
+    if (ring_fd == FD_ERR) {
+        throw runtime_errorf("io_uring_setup() failed: %s", strerror(errno));
+    }
+
+    try {
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) { // both rings share one mapping
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) throw std::runtime_error("Failed to map the submission ring.");
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) throw std::runtime_error("Failed to map the completion ring.");
+        }
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) throw std::runtime_error("Failed to map the submission entries.");
+
+        char* sq = static_cast<char*>(sq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        char* cq = static_cast<char*>(cq_ptr);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        probe();
+    } catch (...) {
+        teardown();
+        throw;
+    }
+    this->entries = p.sq_entries; // a run() never has more in flight, the completion ring cannot overflow
+}
+
+UringRing::~UringRing() {
+    teardown();
+}
+
+unsigned UringRing::capacity() const {
+    return entries;
+}
+
+void UringRing::prepare(const fd_t fd, const msghdr* msg, const uint64_t user_data) {
+    unsigned tail = *sq_tail;
+    unsigned at = tail & *sq_mask;
+    io_uring_sqe& sqe = sqes[at];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_SENDMSG;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(msg);
+    sqe.len = 1;
+    sqe.msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT; // never parked on a poll, -EAGAIN comes back at once
+    sqe.user_data = user_data;
+    sq_array[at] = at;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+UringRing* UringRing::local() {
+    if (!thread_ring && !thread_ring_failed) {
+        try {
+            thread_ring.reset(new UringRing());
+        } catch (const std::exception& e) {
+            thread_ring_failed = true;
+            ERROR("io_uring unavailable on this thread, sending with send(): %s", e.what());
+        }
+    }
+    return thread_ring.get();
+}
+
+void UringRing::discard_local() {
+    thread_ring.reset();
+    thread_ring_failed = true;
+}
+
+UringEngine::UringEngine(): seq(0) {
+    if (!UringRing::local()) throw std::runtime_error("No io_uring for this thread.");
+}
+
+bool UringEngine::is_async() const {
+    return true;
+}
+
+DrainResult UringEngine::drain(const fd_t fd, OutQueue& q) {
+    if (q.inflight) return DrainResult::IN_FLIGHT;
+    if (q.chunks.empty()) return DrainResult::DRAINED;
+
+    Send s{};
+    for (auto c = q.chunks.begin(); c != q.chunks.end() && s.iov.size() < MAX_FLUSH_IOV; ++c) {
+        s.frames.push_back(c->frame);
+        s.iov.push_back({const_cast<char*>(c->frame->data() + c->off), c->frame->size() - c->off});
+    }
+    s.msg.msg_iov = s.iov.data();
+    s.msg.msg_iovlen = s.iov.size();
+    s.fd = fd;
+    s.tag = q.inflight = ++seq; // tag 0 means "nothing in flight"
+    sends.push_back(std::move(s));
+    return DrainResult::IN_FLIGHT;
+}
+
+void UringEngine::submit(const CompletionHandler& on_complete) {
+    // completions may record follow-up sends (partial writes, chunks past MAX_FLUSH_IOV), loop until nothing is left
+    // behind: no EPOLLOUT is armed for an inflight queue. Every completion either wrote bytes or settled its queue.
+    while (!sends.empty()) {
+        issued.clear();
+        issued.swap(sends); // drain() from the handlers below records into the emptied list
+
+        UringRing* ring = UringRing::local();
+        for (size_t from = 0; from < issued.size();) {
+            size_t n = ring ? std::min<size_t>(issued.size() - from, ring->capacity()) : issued.size() - from;
+            if (!ring) { // plain nonblocking send(), same results as the ring would give
+                for (size_t i = from; i < from + n; i++) {
+                    const Send& s = issued[i];
+                    ssize_t res = sendmsg(s.fd, &s.msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+                    on_complete(s.fd, s.tag, res < 0 ? -errno : res);
+                }
+                from += n;
+                continue;
+            }
+
+            for (size_t i = from; i < from + n; i++) {
+                const Send& s = issued[i];
+                ring->prepare(s.fd, &s.msg, i);
+            }
+            try {
+                ring->run(static_cast<unsigned>(n), [&](const uint64_t idx, const ssize_t res) {
+                    const Send& s = issued[idx];
+                    on_complete(s.fd, s.tag, res); // may record the next send of the same connection
+                });
+            } catch (...) {
+                UringRing::discard_local(); // closing it cancels whatever is left, this thread sends directly from now on
+                throw;
+            }
+            from += n;
+        }
+    }
+}
+
+#pragma region PRIVATE_FUNC
+void UringRing::teardown() {
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_size);
+    sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    cq_ptr = sq_ptr = MAP_FAILED;
+
+    if (ring_fd != FD_ERR) {
+        close(ring_fd);
+        ring_fd = FD_ERR;
+    }
+}
+
+void UringRing::probe() {
+    size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    io_uring_probe* pr = static_cast<io_uring_probe*>(calloc(1, len));
+    if (!pr) throw std::runtime_error("Failed to allocate io_uring probe.");
+
+    bool ok = io_uring_register(ring_fd, IORING_REGISTER_PROBE, pr, 256) == 0
+        && pr->last_op >= IORING_OP_SENDMSG
+        && (pr->ops[IORING_OP_SENDMSG].flags & IO_URING_OP_SUPPORTED);
+    free(pr);
+    if (!ok) throw std::runtime_error("IORING_OP_SENDMSG is not supported.");
+}
+
+void UringRing::enter(unsigned& unsent, const unsigned wait) {
+    int n = io_uring_enter(ring_fd, unsent, wait, IORING_ENTER_GETEVENTS);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) return; // completions that did arrive are reaped meanwhile
+        throw runtime_errorf("io_uring_enter() failed: %s", strerror(errno));
+    }
+    unsent -= std::min<unsigned>(unsent, static_cast<unsigned>(n));
+}
+#pragma endregion
@@ -0,0 +1,94 @@
+#ifndef __URING_ENGINE_H__
+#define __URING_ENGINE_H__
+
+#define URING_ENTRIES       		256 // submission slots of a thread's ring, the completion ring gets twice as many
+
+#include <vector>
+#include <cstdint>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+#include "io_engine.h"
+
+/*
+io_uring through the raw syscalls, no liburing dependency.
+Only the write path goes through the ring, readiness, accept and recv stay with ConnectionTracker's epoll set.
+
+A thread has one ring, shared by every engine it runs, e.g. all the channels a scheduler worker ticks.
+drain() only records a sendmsg over up to MAX_FLUSH_IOV queued chunks; submit() writes the engine's batch into
+the calling thread's ring and one io_uring_enter() issues it and waits for it. The sends carry MSG_DONTWAIT, so they complete at once (-EAGAIN
+on a full socket) and the ring is empty again whenever submit() returns: the next tick may run on another worker.
+*/
+
+class UringRing {
+    private:
+        fd_t ring_fd;
+        void* sq_ptr;
+        size_t sq_size;
+        void* cq_ptr;
+        size_t cq_size;
+        io_uring_sqe* sqes;
+        size_t sqes_size;
+
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        io_uring_cqe* cqes;
+        unsigned entries;
+    public:
+        UringRing(const unsigned entries = URING_ENTRIES); // throws if io_uring or IORING_OP_SENDMSG is unavailable
+        ~UringRing();
+        UringRing(const UringRing&) = delete;
+        UringRing& operator=(const UringRing&) = delete;
+
+        unsigned capacity() const; // sends one run() can take
+        void prepare(const fd_t fd, const msghdr* msg, const uint64_t user_data); // msg and its iovec live until the completion
+        template <typename F>
+        void run(unsigned count, F&& on_cqe); // issues the count prepared sends, on_cqe(user_data, res) for each once done
+
+        static UringRing* local(); // the calling thread's, nullptr if it cannot have one
+        static void discard_local(); // after a failed run(): sends may be left in it, later ones go through send()
+    private:
+        void probe();
+        void teardown(); // unmaps the rings and closes the ring fd
+        void enter(unsigned& unsent, const unsigned wait); // a transient failure returns as is, the caller retries
+};
+
+class UringEngine : public IoEngine {
+    private:
+        struct Send {
+            std::vector<Frame> frames; // kept alive until the completion is reaped
+            std::vector<iovec> iov; // into frames, a moved Send keeps pointing at the same buffers
+            msghdr msg;
+            fd_t fd;
+            uint64_t tag;
+        };
+
+        std::vector<Send> sends; // recorded by drain(), issued by the next submit()
+        std::vector<Send> issued; // the batch in the ring, indexed by user_data
+        uint64_t seq; // last tag handed out, a completion for a cleared queue does not match it
+    public:
+        UringEngine(); // throws if the constructing thread cannot have a ring
+        virtual bool is_async() const override;
+        virtual DrainResult drain(const fd_t fd, OutQueue& q) override; // records one sendmsg over up to MAX_FLUSH_IOV chunks
+        virtual void submit(const CompletionHandler& on_complete) override; // until no follow-up send is left
+};
+
+template <typename F>
+void UringRing::run(unsigned count, F&& on_cqe) {
+    unsigned unsent = count;
+    while (count > 0) {
+        enter(unsent, count);
+
+        unsigned head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            uint64_t user_data = cqe.user_data;
+            ssize_t res = cqe.res;
+            __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+            count--;
+            on_cqe(user_data, res);
+        }
+    }
+}
+
+#endif
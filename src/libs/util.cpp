@@ -12,4 +12,28 @@ void frees(int num, ...) {
     va_end(ap);
 }
 
+// strict UTF-8 as jansson checks it: no overlongs, no surrogates, nothing above U+10FFFF
+bool valid_utf8(const char* str, const size_t len) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(str);
+    const unsigned char* end = s + len;
+    while (s < end) {
+        unsigned char c = *s;
+        if (c < 0x80) { s++; continue; }
+        int n; uint32_t cp;
+        if ((c & 0xE0) == 0xC0) { n = 1; cp = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0) { n = 2; cp = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0) { n = 3; cp = c & 0x07; }
+        else return false;
+        if (end - s <= n) return false;
+        for (int i = 1; i <= n; i++) {
+            if ((s[i] & 0xC0) != 0x80) return false;
+            cp = (cp << 6) | (s[i] & 0x3F);
+        }
+        if ((n == 1 && cp < 0x80) || (n == 2 && cp < 0x800) || (n == 3 && cp < 0x10000)) return false;
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+        s += n + 1;
+    }
+    return true;
+}
+
 // hash helpers are defined inline in util.h
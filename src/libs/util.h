@@ -40,6 +40,7 @@
 #define __FREES(...)                            frees(CNT_ARGS(__VA_ARGS__), __VA_ARGS__)
 
 void frees(int, ...);
+bool valid_utf8(const char* s, const size_t len); // strict, as jansson checks strings
 
 typedef int msec;
 typedef uint64_t msec64;
@@ -55,6 +56,10 @@ inline constexpr unsigned int hash(const char* str) {
     return str && str[0] ? static_cast<unsigned int>(str[0]) + 0xEDB8832Full * hash(str + 1) : 8603;
 }
 
+inline constexpr int hex_value(const char c) {
+    return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+}
+
 inline std::runtime_error runtime_errorf(const char* s) {
     return std::runtime_error(s);
 }
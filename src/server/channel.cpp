@@ -1,55 +1,52 @@
 #include "channel.h"
 #include "channel_server.h"
+#include "channel_registry.h"
 #include "user_manager.h"
 
-Channel::Channel(ChannelServer* srv, ch_id_t id, const int max_fd): ChatServer(max_fd, 100), channel_id(id), server(srv), paused(false) {
+Channel::Channel(ChannelServer* srv, ChannelRegistry& reg, ChannelScheduler& sched, ch_id_t id, const int max_fd): ChatServer(max_fd, 0, false), channel_id(id), server(srv), registry(reg), scheduler(sched), paused(false) {
     stop_flag.store(false);
-    worker = std::thread(&Channel::proc, this);
 
 	task_runner.pushf(TS_LOGIC, [this]() {
 		resolve_pool();
-	});
+	}, "resolve_pool");
+	task_runner.pushb(TS_PRE, [this]() {
+		resolve_notices();
+	}, "resolve_notices");
+	task_runner.freeze(); // before a worker can tick it
+
+	if (con_tracker) scheduler.attach(this, con_tracker->get_efd());
 }
 Channel::~Channel() {
-    stop_flag.store(true);
-    if (worker.joinable()) {
-        worker.join();
-    }
+    scheduler.detach(this); // waits for a worker still ticking it
 }
 
-void Channel::proc() {
-    while (!stop_flag.load(std::memory_order_relaxed)) {
-        try {
-			task_runner.run();
-        } catch (const std::exception& e) {
-            iERROR("%s", e.what());
-        }
-    }
+void Channel::tick() {
+	try {
+		task_runner.run();
+	} catch (const std::exception& e) {
+		iERROR("%s", e.what());
+	}
 }
 
 void Channel::leave(const fd_t fd, const MessageReqDto& msg) {
 	leave_pool.emplace(fd, msg);
+	scheduler.wake(this);
 }
 
 void Channel::join(const fd_t fd, const MessageReqDto& msg) {
 	if (stop_flag) {
-		if (worker.joinable()) worker.join(); // 기존 죽은 스레드 정리
-		worker = std::thread(&Channel::proc, this); // 새 스레드 시작
 		stop_flag.store(false);
 		empty_since.store(0);
 	}
-	join_pool.emplace(fd, msg);
+	join_pool.emplace(fd, PendingJoin{ConnectionTable::key(fd), msg});
+	scheduler.wake(this); // runs once the caller unlocks the pool
 }
 
 void Channel::leave_and_logging(const fd_t fd, msec64 timestamp) {
 	try {		
-		MessageReqDto sys_msg = { .type = SYSTEM, .text = "leave", .timestamp = timestamp, .channel_id = channel_id };
-		if (!UserManager::get_user_name(fd, sys_msg.user_name)) {
-			next_deletion.insert(fd); // 이름을 알 수 없으면 강제 퇴장
-			return;
-		}
-
-		leave(fd, sys_msg);
+		MessageReqDto sys_msg = { .type = SYSTEM, .text = "leave", .timestamp = timestamp, .user = UserManager::user_of(fd), .channel_id = channel_id };
+		if (sys_msg.user != NO_USER) render(sys_msg); // on the reporting thread, not the channel's
+		leave(fd, sys_msg); // a nameless one is dropped by resolve_pool() on this channel's thread
 	} catch (const std::exception& e) {
 		iERROR("Logging failed: %s", e.what());
 	}
@@ -57,20 +54,26 @@ void Channel::leave_and_logging(const fd_t fd, msec64 timestamp) {
 
 void Channel::join_and_logging(const fd_t fd, msec64 timestamp, bool re) {
 	try {		
-		MessageReqDto sys_msg = { .type = SYSTEM, .timestamp = timestamp, .channel_id = channel_id };
+		MessageReqDto sys_msg = { .type = SYSTEM, .timestamp = timestamp, .user = UserManager::user_of(fd), .channel_id = channel_id };
 
-		if (!UserManager::get_user_name(fd, sys_msg.user_name)) {
+		if (sys_msg.user == NO_USER) {
 			return;
 		}
 
 		sys_msg.text = re ? "rejoin" : "join";
 
+		render(sys_msg); // on the lobby thread, not the channel's
 		join(fd, sys_msg);
 	} catch (const std::exception& e) {
         iERROR("Logging failed: %s", e.what());
     }
 }
 
+void Channel::notify(const fd_t fd, const char* payload) {
+	notices.push(Notice{ConnectionTable::key(fd), payload});
+	scheduler.wake(this);
+}
+
 bool Channel::ping_pool() {
 	if (!con_tracker) return false;
 	return (con_tracker->get_client_count() + join_pool.size()) < static_cast<size_t>(con_tracker->get_max_fd());
@@ -85,6 +88,10 @@ void Channel::start_pooling() {
 }
 
 msec64 Channel::get_empty_since() const { return empty_since.load(); }
+
+PoolLock::~PoolLock() {
+	if (channel) channel->start_pooling();
+}
 bool Channel::is_stopped() const { return stop_flag.load(); }
 
 #pragma region PROTECTED_FUNC
@@ -92,84 +99,110 @@ bool Channel::is_stopped() const { return stop_flag.load(); }
 void Channel::on_accept(const fd_t client) {} // accept only occured in lobby(ChannelServer)
 void Channel::resolve_deletion() {
 	if (!con_tracker) return;
+	if (!next_deletion.empty()) Metrics::add(M_DELETIONS, next_deletion.size());
     for (const fd_t fd : next_deletion) {
 		msec64 timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 		
-		MessageReqDto sys_msg = { .type = SYSTEM, .text = "leave", .timestamp = timestamp, .channel_id = channel_id };
-		if (!UserManager::get_user_name(fd, sys_msg.user_name)) {
-			sys_msg.user_name = "unknown";
-		}
-
-		mq.push({fd, sys_msg});
+		MessageReqDto sys_msg = { .type = SYSTEM, .text = "leave", .timestamp = timestamp, .user = UserManager::user_of(fd), .channel_id = channel_id };
+		render(sys_msg); // before close() drops the name, "unknown" if there was none
+		mq.push({fd, std::move(sys_msg)});
+		Metrics::add(M_MQ_PUSHED);
 
 		try {
 			con_tracker->delete_client(fd);
 		} catch (...) {}
 
-		UserManager::remove_user_name(fd);
-        close(fd);
 		comm->clear_buffer(fd);
+		ConnectionTable::close(fd);
+        close(fd);
         LOG("Normally Disconnected: fd %d", fd);
     }
+	if (!next_deletion.empty() && con_tracker->get_client_count() == 0) {
+		scheduler.wake(this); // resolve_pool already ran this tick, it parks the channel on the next one
+	}
 }
 
 void Channel::resolve_pool() {
 	std::lock_guard<std::mutex> lock(pool_mtx);
 	if (!con_tracker) return;
-	std::unordered_map<fd_t, MessageReqDto> local_q = std::move(join_pool);
-	for (const auto& [fd, msg] : local_q) {
+	std::unordered_map<fd_t, PendingJoin> pending = std::move(join_pool);
+	join_pool.clear();
+	for (const auto& [fd, entry] : pending) {
+		if (!ConnectionTable::is_current(entry.key)) continue; // closed while waiting
+		if (!comm->claim(fd)) { // the previous owner has not let go of it yet
+			join_pool.emplace(fd, entry);
+			continue;
+		}
+
+		const MessageReqDto& msg = entry.msg;
 		try {
+			ConnectionTable::at(fd).channel = channel_id;
 			con_tracker->add_client(fd);
 		    mq.push({fd, msg});
+		    Metrics::add(M_MQ_PUSHED);
         	LOG(_CB_ "[Join] User (fd: %d) joined channel %u at %lu" _EC_, fd, channel_id, msg.timestamp);
 		} catch (const std::exception& e) {
 			iERROR("%s", e.what());
 		}
 	}
-	local_q = std::move(leave_pool);
+	if (!join_pool.empty() && !claim_retry) { // the previous owner lets go within its current tick, the timer brings us back after it
+		claim_retry = timers.arm(CLAIM_RETRY, [this]() { claim_retry = 0; });
+	}
+
+	std::unordered_map<fd_t, MessageReqDto> local_q = std::move(leave_pool);
 	for (const auto& [fd, msg] : local_q) {
+		if (msg.user == NO_USER) {
+			next_deletion.insert(fd); // 이름을 알 수 없으면 강제 퇴장
+			continue;
+		}
 		try {
 			con_tracker->delete_client(fd);
+			if (!comm->release(fd)) {
+				shutdown(fd, SHUT_RDWR); // undelivered bytes would break framing on the next channel
+			}
 		    mq.push({fd, msg});
+		    Metrics::add(M_MQ_PUSHED);
 			LOG(_CR_ "[Leave] User (fd: %d) left channel %u at %lu" _EC_, fd, channel_id, msg.timestamp);
 		} catch (const std::exception& e) {
 			iERROR("%s", e.what());
 		}
 	}
 
-	if (con_tracker->get_client_count() == 0 && join_pool.empty()) {
-		stop_flag.store(true);
+	if (con_tracker->get_client_count() == 0 && join_pool.empty() && !stop_flag.exchange(true)) {
 		empty_since.store(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+		registry.notify_idle(channel_id); // arms its expiry
 	}
 }
 
-void Channel::on_req(const fd_t from, const char* target, Json& root) {
-    switch (hash(target)) {
-    case hash("message"):
-    case hash("Message"):
-    case hash("MESSAGE"):
-		ChatServer::on_req(from, target, root);
-        break;
-    case hash("join"):
-    case hash("Join"):
-    case hash("JOIN"):
-        {
-			ch_id_t ch_to;
-			msec64 timestamp;
-			__UNPACK_JSON(root, "{s:I,s:I}", "channel_id", &ch_to, "timestamp", &timestamp) {
-				if (ch_to == channel_id) return;
-				
-				UReportDto dto;
-				dto.join = new JoinReqDto{ .ch_from = channel_id, .ch_to = ch_to, .timestamp = timestamp };
-
-				server->report({ChannelServer::ChannelReport::JOIN, from, dto});
-			} __UNPACK_FAIL {
-				iERROR("Malformed JSON message, missing channel_id.");
-			}
+void Channel::resolve_notices() {
+	if (!notices.pop_all(notice_batch)) return;
+	for (const Notice& notice : notice_batch) {
+		fd_t fd = ConnectionTable::fd_of(notice.key);
+		if (!ConnectionTable::is_current(notice.key) || ConnectionTable::at(fd).owner.load(std::memory_order_acquire) != comm) continue; // closed or not ours anymore
+		try {
+			comm->send_frame(fd, std::string(notice.payload));
+		} catch (const std::exception& e) {
+			iERROR("%s", e.what());
+			next_deletion.insert(fd);
 		}
-    default:
-        break;
-    }
+	}
+	notice_batch.clear();
+}
+
+void Channel::on_join(const fd_t from, const WireRequest& req) {
+	if (!req.has(REQ_CHANNEL_ID | REQ_TIMESTAMP)) {
+		iERROR("Malformed JSON message, missing channel_id.");
+		return;
+	}
+	if (req.channel_id == channel_id) return;
+
+	ChannelServer::ChannelReport report = { .type = ChannelServer::ChannelReport::JOIN, .from = from };
+	report.dto.join = JoinReqDto{ .ch_from = channel_id, .ch_to = req.channel_id, .timestamp = req.timestamp, .user = UserManager::user_of(from) };
+
+	if (!server->report(report)) {
+		iERROR("Lobby is behind, channel switch of fd %d refused.", from);
+		comm->send_frame(from, std::string(R"({"type":"error","message":"Server is busy."})"));
+	}
 }
 
 #pragma endregion
\ No newline at end of file
@@ -1,41 +1,71 @@
 #ifndef __CHANNEL_H__
 #define __CHANNEL_H__
 
+#define CLAIM_RETRY         1 // ms until a join looks again at a connection its previous owner still holds
+
 typedef unsigned int ch_id_t;
 
-#include <thread>
 #include <atomic>
 
 #include "chat_server.h"
+#include "channel_scheduler.h"
 
 class ChannelServer; // Forward declaration
+class ChannelRegistry;
+class Channel;
+
+// Unlocks a pool-locked channel (see ChannelRegistry) when it goes out of scope
+class PoolLock {
+    private:
+        Channel* channel;
+    public:
+        explicit PoolLock(Channel* ch): channel(ch) {}
+        ~PoolLock();
+        PoolLock(const PoolLock&) = delete;
+        PoolLock& operator=(const PoolLock&) = delete;
+};
 
 class Channel: public ChatServer {
     private:
         ch_id_t channel_id;
-        std::thread worker;
-        std::atomic<bool> stop_flag{false};
+        std::atomic<bool> stop_flag{false}; // no members left, parked until the next join
         ChannelServer* server; // upward link
+        ChannelRegistry& registry; // told when the channel runs empty
+        ChannelScheduler& scheduler; // ticks this channel on one of its workers
+
+		struct PendingJoin {
+			uint64_t key; // ConnectionTable key at join time, the connection may close before it is claimed
+			MessageReqDto msg;
+		};
 
 		std::mutex pool_mtx;
-		std::unordered_map<fd_t, MessageReqDto> join_pool;
+		std::unordered_map<fd_t, PendingJoin> join_pool;
 		std::unordered_map<fd_t, MessageReqDto> leave_pool;
+		timer_id_t claim_retry = 0; // armed while join_pool waits on a previous owner, this channel's thread only
+
+		struct Notice {
+			uint64_t key; // ConnectionTable key when it was sent, dropped if the connection moved on
+			const char* payload; // string literal
+		};
+		ProducerConsumerQueue<Notice, QUEUE_MPSC> notices; // frames for one member, sent from this channel's thread
+		std::vector<Notice> notice_batch;
 
 		std::atomic<bool> paused;
 		std::atomic<msec64> empty_since{0};
     public:
-        Channel(ChannelServer* srv, ch_id_t id, const int max_fd = 256);
+        Channel(ChannelServer* srv, ChannelRegistry& reg, ChannelScheduler& sched, ch_id_t id, const int max_fd = 256);
         ~Channel();
 
-        virtual void proc() override;
+        void tick(); // one TaskRunner pass, polling does not block
 
 		// Can be polluted by other threads but protecting by ConnectionTracker's mutex
         void leave(const fd_t fd, const MessageReqDto& msg);
         void join(const fd_t fd, const MessageReqDto& msg);
-		void leave_and_logging(const fd_t fd, msec64 timestamp);
+		void leave_and_logging(const fd_t fd, msec64 timestamp); // pool locked by the caller, like join_and_logging()
 		void join_and_logging(const fd_t fd, msec64 timestamp, bool re = true);
 
 		bool ping_pool();
+		void notify(const fd_t fd, const char* payload); // any thread, the member's buffers are only touched by this channel
 
 		void wait_stop_pooling();
 		void start_pooling();
@@ -46,9 +76,10 @@ class Channel: public ChatServer {
     protected: // Sequencially called in proc() => no needed mutex
 		virtual void resolve_deletion() override;
 		virtual void resolve_pool();
+		void resolve_notices();
 
         virtual void on_accept(const fd_t client) override;
-        virtual void on_req(const fd_t from, const char* target, Json& root) override;
+        virtual void on_join(const fd_t from, const WireRequest& req) override; // switch to another channel
 };
 
 #endif
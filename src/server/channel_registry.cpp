@@ -0,0 +1,132 @@
+#include "channel_registry.h"
+#include "../libs/util.h"
+#include "../libs/metrics.h"
+
+ChannelRegistry::ChannelRegistry(ChannelScheduler& sched, const int ch_max_fd): scheduler(sched), expiry(1000), ch_max_fd(ch_max_fd) {}
+
+ChannelRegistry::~ChannelRegistry() {
+    shutdown();
+}
+
+Channel* ChannelRegistry::get_channel(ChannelServer* owner, const ch_id_t channel_id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return _get_channel(owner, channel_id);
+}
+
+Channel* ChannelRegistry::acquire_channel(ChannelServer* owner, const ch_id_t channel_id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Channel* channel = _get_channel(owner, channel_id);
+    channel->wait_stop_pooling();
+    return channel;
+}
+
+Channel* ChannelRegistry::find_or_create_channel(ChannelServer* owner, ch_id_t preferred_id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Channel* target_ch = _get_channel(owner, preferred_id);
+    target_ch->wait_stop_pooling();
+
+    if (target_ch->ping_pool()) {
+        return target_ch;
+    }
+
+    target_ch->start_pooling(); // Unlock full channel
+    target_ch = nullptr;
+
+    // Try to find an available channel
+    for (auto& [id, candidate] : channels) {
+        if (id == preferred_id) continue;
+        candidate->wait_stop_pooling();
+        if (candidate->ping_pool()) {
+            return candidate;
+        }
+        candidate->start_pooling();
+    }
+
+    // Create new channel
+    ch_id_t new_id = 1;
+    while (channels.find(new_id) != channels.end()) new_id++;
+    target_ch = _get_channel(owner, new_id);
+    target_ch->wait_stop_pooling();
+    
+    return target_ch;
+}
+
+void ChannelRegistry::check_channels() {
+    std::lock_guard<std::mutex> lock(mtx);
+	std::vector<ch_id_t> local_idle;
+	{
+		std::lock_guard<std::mutex> idle_lock(idle_mtx);
+		local_idle.swap(idle);
+	}
+	for (const ch_id_t id : local_idle) {
+		auto it = expiry_timers.find(id);
+		if (it != expiry_timers.end()) expiry.cancel(it->second);
+		expiry_timers[id] = expiry.arm(CHANNEL_EXPIRY, [this, id]() { expire(id); });
+	}
+	expiry.advance();
+}
+
+void ChannelRegistry::notify_idle(const ch_id_t channel_id) {
+	std::lock_guard<std::mutex> lock(idle_mtx);
+	idle.push_back(channel_id);
+}
+
+void ChannelRegistry::shutdown() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& [_, channel] : channels) {
+        delete channel;
+        Metrics::add(M_CHANNELS_DESTROYED);
+    }
+    channels.clear();
+    expiry_timers.clear(); // their callbacks find no channel anymore
+}
+
+void ChannelRegistry::export_timings(JsonWriter& w) {
+    std::lock_guard<std::mutex> lock(mtx); // channels are deleted under it, their histograms are read lock-free
+    w.begin_array();
+    for (auto& [id, channel] : channels) {
+        w.begin_object();
+        w.key("channel_id");
+        w.value(static_cast<long long>(id));
+        w.key("tasks");
+        channel->export_timings(w);
+        w.end_object();
+    }
+    w.end_array();
+}
+
+#pragma region PRIVATE_FUNC
+Channel* ChannelRegistry::_get_channel(ChannelServer* owner, const ch_id_t channel_id) {
+	auto it = channels.find(channel_id);
+	if (it == channels.end()) {
+		Channel* channel = new Channel(owner, *this, scheduler, channel_id, ch_max_fd);
+		it = channels.emplace(channel_id, channel).first;
+		Metrics::add(M_CHANNELS_CREATED);
+		LOG(_CG_ "Channel %u created." _EC_, channel_id);
+	}
+	return it->second;
+}
+
+void ChannelRegistry::expire(const ch_id_t channel_id) {
+	expiry_timers.erase(channel_id);
+	auto it = channels.find(channel_id);
+	if (it == channels.end()) return;
+
+	Channel* ch = it->second;
+	ch->wait_stop_pooling(); // a shard may still be placing a user here
+	msec64 now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	msec64 since = ch->get_empty_since();
+	bool stopped = ch->is_stopped() && since > 0;
+	ch->start_pooling();
+	if (!stopped) return; // rejoined, the next time it runs empty it reports again
+
+	if (now - since < CHANNEL_EXPIRY) { // emptied again after this timer was armed
+		expiry_timers[channel_id] = expiry.arm(static_cast<msec>(CHANNEL_EXPIRY - (now - since)), [this, channel_id]() { expire(channel_id); });
+		return;
+	}
+	LOG(_CG_ "Channel %u destroyed due to inactivity." _EC_, channel_id);
+	delete ch;
+	channels.erase(it);
+	Metrics::add(M_CHANNELS_DESTROYED);
+}
+#pragma endregion
@@ -0,0 +1,50 @@
+#ifndef __CHANNEL_REGISTRY_H__
+#define __CHANNEL_REGISTRY_H__
+
+#define CHANNEL_EXPIRY      300000 // ms an empty channel is kept, 5 minutes
+
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+
+#include "channel.h"
+#include "channel_scheduler.h"
+#include "../libs/timer_wheel.h"
+
+class ChannelServer; // Forward declaration
+
+/* Requirement of ChannelRegistry
+- Share Channels: one set of channels for every lobby shard.
+- Lock Order: registry mutex before a channel's pool mutex. Pool-locked channels are handed out, the registry mutex never is.
+- Expire Channels: a channel that runs empty reports itself, only those are armed in the expiry wheel.
+*/
+
+class ChannelRegistry {
+    private:
+        std::unordered_map<ch_id_t, Channel*> channels;
+        std::mutex mtx;
+        ChannelScheduler& scheduler;
+
+        TimerWheel expiry; // guarded by mtx, advanced by check_channels()
+        std::unordered_map<ch_id_t, timer_id_t> expiry_timers;
+        std::mutex idle_mtx; // leaf lock, taken by channels under their pool mutex
+        std::vector<ch_id_t> idle;
+
+        int ch_max_fd;
+    public:
+        ChannelRegistry(ChannelScheduler& sched, const int ch_max_fd = 32);
+        ~ChannelRegistry();
+
+        Channel* get_channel(ChannelServer* owner, const ch_id_t channel_id); // created on demand, reports go to owner
+        Channel* acquire_channel(ChannelServer* owner, const ch_id_t channel_id); // returned pool-locked
+        Channel* find_or_create_channel(ChannelServer* owner, ch_id_t preferred_id); // returned pool-locked
+        void check_channels();
+        void notify_idle(const ch_id_t channel_id); // the channel just ran empty
+        void shutdown(); // destroys every channel, call once no lobby shard is running
+        void export_timings(JsonWriter& w); // array of {channel_id, tasks}, see ServerBase::export_timings()
+    private:
+        Channel* _get_channel(ChannelServer* owner, const ch_id_t channel_id);
+        void expire(const ch_id_t channel_id);
+};
+
+#endif
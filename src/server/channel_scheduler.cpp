@@ -0,0 +1,157 @@
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+
+#include "channel_scheduler.h"
+#include "channel.h"
+
+ChannelScheduler::ChannelScheduler(const int n_workers): mfd(FD_ERR), wake_fd(FD_ERR), running(true) {
+    if ((mfd = epoll_create1(EPOLL_CLOEXEC)) == FD_ERR) {
+        throw std::runtime_error("Failed to create scheduler epoll instance.");
+    }
+    if ((wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == FD_ERR) {
+        close(mfd);
+        throw std::runtime_error("Failed to create scheduler eventfd.");
+    }
+
+    pollev ev{};
+    ev.events = EPOLLIN | EPOLLET; // a level-triggered one would wake every idle worker per notify()
+    ev.data.ptr = nullptr; // every other entry is a Channel*
+    if (FAILED(epoll_ctl(mfd, EPOLL_CTL_ADD, wake_fd, &ev))) {
+        close(wake_fd);
+        close(mfd);
+        throw std::runtime_error("Failed to add scheduler eventfd to epoll.");
+    }
+
+    int n = n_workers > 0 ? n_workers : std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < n; i++) {
+        workers.emplace_back(&ChannelScheduler::work, this);
+    }
+    LOG(_CG_ "Channel scheduler started with %d workers." _EC_, n);
+}
+
+ChannelScheduler::~ChannelScheduler() {
+    stop();
+    close(wake_fd);
+    close(mfd);
+}
+
+void ChannelScheduler::attach(Channel* ch, const fd_t poll_fd) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        slots[ch] = {IDLE, poll_fd};
+    }
+
+    pollev ev{};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = ch;
+    if (FAILED(epoll_ctl(mfd, EPOLL_CTL_ADD, poll_fd, &ev))) {
+        std::lock_guard<std::mutex> lock(mtx);
+        slots.erase(ch);
+        throw runtime_errorf("Failed to add channel epoll fd %d to scheduler.", poll_fd);
+    }
+}
+
+void ChannelScheduler::detach(Channel* ch) {
+    std::unique_lock<std::mutex> lock(mtx);
+    auto it = slots.find(ch);
+    if (it == slots.end()) return;
+    epoll_ctl(mfd, EPOLL_CTL_DEL, it->second.poll_fd, nullptr);
+
+    done_cv.wait(lock, [this, ch]() {
+        RunState state = slots[ch].state;
+        return state != RUNNING && state != RERUN;
+    });
+    run_q.erase(std::remove(run_q.begin(), run_q.end(), ch), run_q.end());
+    slots.erase(ch);
+}
+
+void ChannelScheduler::wake(Channel* ch) {
+    bool queued;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        queued = enqueue(ch);
+    }
+    if (queued) notify();
+}
+
+void ChannelScheduler::stop() {
+    if (!running.exchange(false)) return;
+    pollev ev{};
+    ev.events = EPOLLIN; // level-triggered from now on: the counter is never read, so every worker sees it
+    ev.data.ptr = nullptr;
+    epoll_ctl(mfd, EPOLL_CTL_MOD, wake_fd, &ev);
+    notify();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+}
+
+#pragma region PRIVATE_FUNC
+void ChannelScheduler::work() {
+    pollev evs[MAX_SCHED_EV];
+    while (running.load(std::memory_order_relaxed)) {
+        Channel* ch = nullptr;
+        bool more = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!run_q.empty()) {
+                ch = run_q.front();
+                run_q.pop_front();
+                slots[ch].state = RUNNING;
+                more = !run_q.empty();
+            }
+        }
+        if (more) notify(); // one notify() wakes one worker, each hands the rest of run_q on to the next
+
+        if (!ch) {
+            int n = epoll_wait(mfd, evs, MAX_SCHED_EV, -1);
+            if (n <= 0 || !running.load(std::memory_order_relaxed)) continue;
+
+            std::lock_guard<std::mutex> lock(mtx);
+            for (int i = 0; i < n; i++) {
+                if (evs[i].data.ptr) enqueue(static_cast<Channel*>(evs[i].data.ptr)); // the wake_fd entry only ended the wait
+            }
+            continue;
+        }
+
+        ch->tick();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        Slot& slot = slots[ch];
+        if (slot.state == RERUN) {
+            slot.state = QUEUED;
+            run_q.push_back(ch);
+        } else {
+            slot.state = IDLE;
+            pollev ev{};
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.ptr = ch;
+            epoll_ctl(mfd, EPOLL_CTL_MOD, slot.poll_fd, &ev); // readiness left in its epoll set fires again right away
+        }
+        done_cv.notify_all();
+    }
+}
+
+bool ChannelScheduler::enqueue(Channel* ch) {
+    auto it = slots.find(ch);
+    if (it == slots.end()) return false; // detached meanwhile
+
+    switch (it->second.state) {
+    case IDLE:
+        it->second.state = QUEUED;
+        run_q.push_back(ch);
+        return true;
+    case RUNNING:
+        it->second.state = RERUN;
+        return false;
+    default:
+        return false;
+    }
+}
+
+void ChannelScheduler::notify() {
+    eventfd_write(wake_fd, 1);
+}
+#pragma endregion
@@ -0,0 +1,64 @@
+#ifndef __CHANNEL_SCHEDULER_H__
+#define __CHANNEL_SCHEDULER_H__
+
+#define MAX_SCHED_EV        16
+
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sys/epoll.h>
+
+#include "../libs/socket.h"
+#include "../libs/util.h"
+
+class Channel; // Forward declaration
+
+/* Requirement of ChannelScheduler
+- M:N: channels are ticked as tasks on a fixed set of worker threads instead of owning one thread each.
+- Wake on Demand: a channel runs when its epoll set has readiness (its epoll fd is nested in the scheduler's, EPOLLONESHOT) or when wake() is called for queued joins/leaves.
+- Balance: ready channels go through one shared run queue, a busy channel re-queues behind the others after every tick.
+- A channel is ticked by at most one worker at a time.
+*/
+
+class ChannelScheduler {
+    private:
+        enum RunState {
+            IDLE,    // waiting for readiness or wake()
+            QUEUED,  // in run_q
+            RUNNING, // ticked by a worker
+            RERUN    // woken while running, queued again once the tick ends
+        };
+        struct Slot {
+            RunState state;
+            fd_t poll_fd; // the channel's own epoll fd
+        };
+
+        fd_t mfd; // master epoll over every channel's epoll fd
+        fd_t wake_fd; // eventfd, edge-triggered: a write rouses one worker blocked in epoll_wait, never read
+
+        std::unordered_map<Channel*, Slot> slots;
+        std::deque<Channel*> run_q;
+        std::mutex mtx;
+        std::condition_variable done_cv; // a tick ended, detach() may be waiting for it
+
+        std::vector<std::thread> workers;
+        std::atomic<bool> running;
+    public:
+        ChannelScheduler(const int n_workers = 0); // 0 => one per core
+        ~ChannelScheduler();
+
+        void attach(Channel* ch, const fd_t poll_fd);
+        void detach(Channel* ch); // blocks until no worker is ticking ch
+        void wake(Channel* ch);
+        void stop();
+    private:
+        void work();
+        bool enqueue(Channel* ch); // mtx held, true if ch was put on run_q
+        void notify();
+};
+
+#endif
@@ -1,15 +1,20 @@
 #ifndef __CHANNEL_SERVER_H__
 #define __CHANNEL_SERVER_H__
 
+#define LOBBY_TIMEOUT       5000 // ms to send a join after accept
+#define REPORT_QUEUE        4096 // pending channel reports per lobby, report() refuses more
+
 #include "typed_frame_server.h"
 #include "chat_server.h"
 #include "channel.h"
+#include "channel_registry.h"
 #include "../libs/json.h"
 
 
 /* Requirement of ChannelServer
 - Manage Channels: Create and manage multiple Channel instances.
 - Handle Channel Reports: Process requests from channels.
+- Shard Lobbies: several ChannelServers may accept on the same port, all sharing one ChannelRegistry.
 
 */
 
@@ -21,27 +26,21 @@ class ChannelServer: public TypedFrameServer {
 			UReportDto dto;
         };
     private:
-        std::unordered_map<ch_id_t, Channel*> channels;
-		ProducerConsumerQueue<ChannelReport> reports;
-        std::mutex report_mtx;
-		std::unordered_map<fd_t, std::chrono::steady_clock::time_point> last_act;
-
-		int ch_max_fd;
+        ChannelRegistry& registry;
+		ProducerConsumerQueue<ChannelReport, QUEUE_MPSC, REPORT_QUEUE, OVERFLOW_REJECT> reports; // pushed by channel threads, drained by this lobby, a preallocated ring
+		std::vector<ChannelReport> report_batch;
     public:
-        ChannelServer(const int max_fd = 256, const int ch_max_fd = 32, const msec to = 0);
+        ChannelServer(ChannelRegistry& registry, const int max_fd = 256, const msec to = -1); // blocks until a client, a report or a timer is due
         ~ChannelServer();
-        void report(const ChannelReport& req);
+        bool report(const ChannelReport& req); // false while the lobby is REPORT_QUEUE reports behind
     protected:
 		virtual void resolve_deletion() override;
 
 		virtual void on_accept(const fd_t client) override;
-        virtual void on_req(const fd_t from, const char* target, Json& root) override;
+        virtual void on_join(const fd_t from, const WireRequest& req) override;
 		void consume_report();
 	private:
-		Channel* get_channel(const ch_id_t channel_id);
-        Channel* find_or_create_channel(ch_id_t preferred_id);
-		void check_lobby();
-		void check_channels();
+		void schedule_channel_check(); // re-arms itself, drives the registry's expiry wheel
 };
 
 
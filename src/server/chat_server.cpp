@@ -4,116 +4,281 @@
 #include "user_manager.h"
 
 
-ChatServer::ChatServer(const int max_fd, const msec to): TypedFrameServer(max_fd, to) {
-	task_runner.pushb(TS_PRE, [this]() {
-		cur_msgs.clear();
-	});
-    // 매 틱마다 mq를 확인하고 브로드캐스트 수행 (이벤트가 없어도 실행됨)
+ChatServer::ChatServer(const int max_fd, const msec to, const bool listening): TypedFrameServer(max_fd, to, listening), window_bytes(0), arrivals(0), flush_timer(0), flush_due(false), msg_rate(0), last_arrival(0), recv_stamp(0), trace_skip(0) {
+    // 매 틱마다 mq를 확인하고, 윈도우가 찼거나 마감이 되었을 때만 브로드캐스트 수행
     task_runner.pushf(TS_LOGIC, [this]() {
         resolve_timestamps();
         resolve_broadcast();
-    });
+    }, "resolve_window");
 }
 
 ChatServer::~ChatServer() {
 	cur_msgs.clear();
+	arena.reset();
 }
 
 #pragma region PROTECTED_FUNC
 void ChatServer::resolve_deletion() {
 	if (!con_tracker) return;
+	if (!next_deletion.empty()) Metrics::add(M_DELETIONS, next_deletion.size());
     for (const fd_t fd : next_deletion) {
 		try {
         	con_tracker->delete_client(fd);
 		} catch (...) {
 			continue;
 		}
-		UserManager::remove_user_name(fd);
-        close(fd);
 		comm->clear_buffer(fd);
+		ConnectionTable::close(fd);
+        close(fd);
         LOG("Normally Disconnected: fd %d", fd);
     }
 }
 
 void ChatServer::resolve_timestamps() {
-    std::queue<std::pair<fd_t, MessageReqDto>> local_q = mq.pop_all();
-	while (!local_q.empty()) {
-        std::pair<fd_t, MessageReqDto> item = std::move(local_q.front());
-        local_q.pop();
+	if (size_t n = mq.pop_all(mq_batch)) Metrics::add(M_MQ_POPPED, n);
+	for (std::pair<fd_t, MessageReqDto>& item : mq_batch) {
+		if (!item.second.json.empty() || render(item.second)) { // produced without render()
+			append_window(item.second.timestamp, item.second.json);
+		}
+	}
+	mq_batch.clear();
+	if (arrivals == 0) return;
 
-		cur_msgs.emplace(item.second.timestamp, std::pair<fd_t, MessageReqDto>(item.first, item.second));
+	msec64 now = TimerWheel::now_ms();
+	if (last_arrival) {
+		double dt = static_cast<double>(std::max<msec64>(now - last_arrival, 1));
+		msg_rate = 0.8 * msg_rate + 0.2 * (arrivals * 1000.0 / dt);
 	}
+	last_arrival = now;
+	arrivals = 0;
 }
 
 void ChatServer::resolve_broadcast() {
-    Json cur_window(json_array());
-    for (const auto& [timestamp, req] : cur_msgs) {
-		std::string type;
-		switch (req.second.type)
-		{
-		case USER:
-		{
-			type = "user";
-			__ALLOC_JSON_NEW(payload, "{s:s,s:s,s:s,s:I}",
-			"type", type.c_str(), "user_name", req.second.user_name.c_str(), "event", req.second.text.c_str(), "timestamp", timestamp) {
-				json_array_append_new(cur_window.get(), payload);
-			} __ALLOC_FAIL {
-				iERROR("Failed to create broadcast JSON.");
-				continue;
-			}
-		}
-			break;
-		case SYSTEM:
-		{
-			type = "system";
-			__ALLOC_JSON_NEW(payload, "{s:s,s:s,s:s,s:I,s:I}",
-			"type", type.c_str(), "user_name", req.second.user_name.c_str(), "event", req.second.text.c_str(), "timestamp", timestamp, "channel_id", req.second.channel_id) {
-				json_array_append_new(cur_window.get(), payload);
-			} __ALLOC_FAIL {
-				iERROR("Failed to create broadcast JSON.");
-				continue;
-			}
-		}
-			break;
-		default:
-			break;
+	if (cur_msgs.empty()) return; // nothing to say
+
+	bool full = cur_msgs.size() >= options.batch_msgs || window_bytes >= options.batch_bytes;
+	if (!full && !flush_due) {
+		if (flush_timer) return; // still waiting
+		msec delay = flush_delay();
+		if (delay > 0) {
+			flush_timer = timers.arm(delay, [this]() {
+				flush_timer = 0;
+				flush_due = true; // flushed later in the same tick
+			});
+			return;
 		}
-		
+	}
+	flush_window();
+}
+
+void ChatServer::flush_window() {
+	timers.cancel(flush_timer);
+	flush_timer = 0;
+	flush_due = false;
+	if (cur_msgs.empty()) return;
+	uint64_t assembly = traced.empty() ? 0 : MessageTrace::now();
+
+	// fragments were rendered by the producers, assembling the window is a concatenation
+	sort_window();
+	window.clear();
+	window.reserve(window_bytes + 2);
+	window.begin_array();
+    for (const WindowEntry& entry : cur_msgs) {
+		window.raw(entry.json);
     }
-    CharDump dumped(json_dumps(cur_window.get(), 0));
-    if (dumped) {
-		if (!comm || !con_tracker) return;
-		std::vector<fd_t> failed_fds = comm->broadcast(con_tracker->get_clients(), dumped.get());
-		for (const fd_t& fd : failed_fds) {
-			next_deletion.insert(fd);
+	window.end_array();
+	Metrics::add(M_WINDOWS);
+	Metrics::add(M_WINDOW_MSGS, cur_msgs.size());
+	auto reset = [this]() { // after the broadcast, broadcast_pieces() reads the entries again
+		cur_msgs.clear();
+		arena.reset();
+		window_bytes = 0;
+	};
+
+	std::shared_ptr<MessageTrace::Window> trace; // its last owner is the last recipient's write
+	if (!traced.empty()) {
+		trace = std::make_shared<MessageTrace::Window>(std::move(traced), assembly, MessageTrace::now());
+		traced.clear();
+	}
+
+	if (!comm || !con_tracker) {
+		if (trace) trace->drop();
+		reset();
+		return;
+	}
+	std::vector<fd_t> failed_fds;
+	try {
+		std::vector<fd_t> clients = con_tracker->get_clients(), narrow;
+		if (window.str().size() > MAX_FRAME_SIZE) { // only binary peers take it whole
+			auto cut = std::stable_partition(clients.begin(), clients.end(), [&](const fd_t fd) { return comm->max_payload(fd) >= window.str().size(); });
+			narrow.assign(cut, clients.end());
+			clients.erase(cut, clients.end());
 		}
-    }
+		failed_fds = comm->broadcast(clients, window.str(), trace); // encoding cannot fail, append_window() keeps the window within a frame
+		if (!narrow.empty()) broadcast_pieces(narrow, trace, failed_fds);
+	} catch (...) {
+		if (trace) trace->drop(); // a throw time is no "sent" stamp
+		reset();
+		throw;
+	}
+	reset();
+	if (!failed_fds.empty()) Metrics::add(M_SEND_FAILED, failed_fds.size());
+	for (const fd_t& fd : failed_fds) {
+		next_deletion.insert(fd);
+	}
 }
 
-void ChatServer::on_req(const fd_t from, const char* target, Json& root) {
-	switch (hash(target))
-	{
-	case hash("message"):
-	case hash("Message"):
-	case hash("MESSAGE"):
-		const char* text;
-		msec64 timestamp;
-		__UNPACK_JSON(root, "{s:s,s:I}", "text", &text, "timestamp", &timestamp) {
-			std::string user_name;
-			if (!UserManager::get_user_name(from, user_name)) {
-				return;
-			}
-			MessageReqDto msg_req = { .type = USER, .text = std::string(text), .timestamp = timestamp, .user_name = user_name };
-			mq.push({from, msg_req});
-		} __UNPACK_FAIL {
-			iERROR("Malformed JSON message, missing timestamp or text.");
-			return;
+void ChatServer::broadcast_pieces(std::vector<fd_t>& clients, const std::shared_ptr<void>& keep, std::vector<fd_t>& failed) {
+	// the sorted entries again, joined into arrays that fit a hex frame, one larger than that reaches no hex peer
+	JsonWriter piece;
+	size_t bytes = 2, skipped = 0; // "[]"
+	auto send = [&]() {
+		piece.end_array();
+		std::vector<fd_t> lost = comm->broadcast(clients, piece.str(), keep);
+		for (const fd_t fd : lost) clients.erase(std::find(clients.begin(), clients.end(), fd)); // not tried again with the next piece
+		failed.insert(failed.end(), lost.begin(), lost.end());
+		piece.clear();
+		piece.begin_array();
+		bytes = 2;
+	};
+	piece.begin_array();
+	for (const WindowEntry& entry : cur_msgs) {
+		if (entry.json.size() + 2 > MAX_FRAME_SIZE) {
+			skipped++;
+			continue;
 		}
-		break;
-	
-	default:
-		break;
+		if (bytes > 2 && bytes + entry.json.size() + 2 > MAX_FRAME_SIZE) send();
+		piece.raw(entry.json);
+		bytes += entry.json.size() + 2; // ", "
+	}
+	if (bytes > 2) send();
+	if (skipped > 0) {
+		iERROR("%zu messages too large for %zu hex-framed connections, skipped for them.", skipped, clients.size());
 	}
 }
 
+void ChatServer::on_message(const fd_t from, const WireRequest& req) {
+	if (!req.has(REQ_TEXT | REQ_TIMESTAMP)) {
+		iERROR("Malformed JSON message, missing timestamp or text.");
+		return;
+	}
+	// already on the channel's thread: straight into the window, no DTO and no queue
+	bool ok = false;
+	scratch.clear();
+	NameTable::with_name(UserManager::user_of(from), [&](std::string_view name) { // no copy of the name
+		ok = render(scratch, USER, name, req.text, req.timestamp);
+	});
+	if (!ok) return;
+	if (scratch.str().size() + 2 > comm->max_payload(from)) { // a hex sender could not even get its own message back
+		iERROR("Rendered message of %zu bytes exceeds the sender's frame limit, dropped.", scratch.str().size());
+		reject_oversized(from);
+		return;
+	}
+	if (!options.trace_every || ++trace_skip < options.trace_every) {
+		if (!append_window(req.timestamp, scratch.str())) reject_oversized(from);
+		return;
+	}
+	trace_skip = 0;
+	MessageTrace::Stamps stamps{recv_stamp, MessageTrace::now()};
+	if (!append_window(req.timestamp, scratch.str())) {
+		reject_oversized(from);
+		return;
+	}
+	traced.push_back(stamps); // after append_window(), which may have flushed the previous window
+}
+
+void ChatServer::on_recv(const fd_t from) {
+	if (options.trace_every) recv_stamp = MessageTrace::now(); // shared by every frame of this read
+	TypedFrameServer::on_recv(from);
+}
+
+bool ChatServer::append_window(const msec64 timestamp, std::string_view json) {
+	size_t limit = comm ? comm->max_payload() : MAX_FRAME_SIZE;
+	if (json.size() + 2 > limit) { // escaping can grow a frame-sized text past the limit, no window could carry it
+		iERROR("Rendered message of %zu bytes exceeds the frame limit, dropped.", json.size());
+		return false;
+	}
+	if (!cur_msgs.empty() && (cur_msgs.size() >= options.batch_msgs || window_bytes + json.size() + 2 > options.batch_bytes)) {
+		flush_window(); // a burst within one tick must not outgrow the frame limit
+	}
+	cur_msgs.push_back(WindowEntry{timestamp, arena.copy(json)});
+	window_bytes += json.size() + 2; // ", "
+	arrivals++;
+	Metrics::add(M_MESSAGES_IN);
+	return true;
+}
+
+void ChatServer::reject_oversized(const fd_t from) {
+	comm->send_frame(from, std::string(R"({"type":"error","message":"Message too large."})")); // on the sender's own channel thread
+}
+
+bool ChatServer::render(MessageReqDto& msg) {
+	JsonWriter w;
+	bool ok = false;
+	auto emit = [&](std::string_view name) {
+		w.reserve(name.size() + msg.text.size() + 96); // keys, quoting and the numbers
+		ok = render(w, msg.type, name, msg.text, msg.timestamp, msg.channel_id);
+	};
+	if (!NameTable::with_name(msg.user, emit)) emit("unknown"); // the sender is gone already
+	if (!ok) return false;
+	msg.json = w.take();
+	return true;
+}
+
+bool ChatServer::render(JsonWriter& w, const MsgType type, std::string_view user_name, std::string_view text, const msec64 timestamp, const ch_id_t channel_id) {
+	if (type != USER && type != SYSTEM) return false;
+	if (!valid_utf8(user_name.data(), user_name.size()) || !valid_utf8(text.data(), text.size())) {
+		ERROR("Failed to create broadcast JSON."); // json_pack() refused these as well
+		return false;
+	}
+
+	w.begin_object();
+	w.key("type");
+	w.value(type == USER ? "user" : "system");
+	w.key("user_name");
+	w.value(user_name);
+	w.key("event");
+	w.value(text);
+	w.key("timestamp");
+	w.value(static_cast<long long>(timestamp));
+	if (type == SYSTEM) {
+		w.key("channel_id");
+		w.value(static_cast<long long>(channel_id));
+	}
+	w.end_object();
+	return true;
+}
+
+#pragma endregion
+
+#pragma region PRIVATE_FUNC
+msec ChatServer::flush_delay() const {
+	if (options.batch_delay <= 0 || msg_rate <= 0) return 0;
+
+	double expected = msg_rate * options.batch_delay / 1000.0; // arrivals likely within the latency budget
+	if (expected < 1.0) return 0; // nobody would join the window, send now
+	double fill = options.batch_msgs * 1000.0 / msg_rate; // ms until the window is full anyway
+	return static_cast<msec>(std::min<double>(options.batch_delay, fill));
+}
+
+void ChatServer::sort_window() {
+	size_t n = cur_msgs.size(), i = 1;
+	while (i < n && cur_msgs[i - 1].timestamp <= cur_msgs[i].timestamp) i++;
+	if (i >= n) return; // clients stamp with their own clocks, windows are mostly in order already
+
+	if (sort_tmp.size() < n) sort_tmp.resize(n);
+	WindowEntry* src = cur_msgs.data();
+	WindowEntry* dst = sort_tmp.data();
+	for (size_t width = 1; width < n; width *= 2) {
+		for (size_t lo = 0; lo < n; lo += 2 * width) {
+			size_t mid = std::min(lo + width, n), hi = std::min(lo + 2 * width, n);
+			size_t a = lo, b = mid, k = lo;
+			while (a < mid && b < hi) dst[k++] = src[b].timestamp < src[a].timestamp ? src[b++] : src[a++]; // ties keep arrival order
+			while (a < mid) dst[k++] = src[a++];
+			while (b < hi) dst[k++] = src[b++];
+		}
+		std::swap(src, dst);
+	}
+	if (src != cur_msgs.data()) std::copy(src, src + n, cur_msgs.data());
+}
 #pragma endregion
\ No newline at end of file
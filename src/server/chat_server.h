@@ -5,27 +5,64 @@
 #include "../libs/json.h"
 #include "../libs/dto.h"
 #include "../libs/producer_consumer.h"
+#include "../libs/json_writer.h"
+#include "../libs/bump_arena.h"
 
 /* Requirement of ChatServer 
 - Payload Resolution: process received payloads from clients. The format is JSON strings.
 - Timestamp Handling: extract timestamps from messages and order them.
-- Broadcast Handling: periodically broadcast messages to all connected clients.
+- Broadcast Handling: broadcast windows of messages to all connected clients. A window is flushed when it is full or its deadline fires, never while empty.
+- Adaptive Window: the deadline follows the channel's message rate, a quiet channel sends each message right away.
 */
 
 class ChatServer : public TypedFrameServer {
 	protected:
-		std::multimap<msec64, std::pair<fd_t, MessageReqDto>> cur_msgs; // timestamped messages
-		ProducerConsumerQueue<std::pair<fd_t, MessageReqDto>> mq; // message queue (raw JSON strings)
+		struct WindowEntry {
+			msec64 timestamp;
+			std::string_view json; // rendered message, stored in arena
+		};
+
+		std::vector<WindowEntry> cur_msgs; // arrival order, stably sorted by timestamp on flush
+		std::vector<WindowEntry> sort_tmp; // merge buffer, kept across flushes
+		BumpArena arena; // fragments of cur_msgs, rewound on flush
+		ProducerConsumerQueue<std::pair<fd_t, MessageReqDto>, QUEUE_MPSC> mq; // messages from other threads and system notices
+		std::vector<std::pair<fd_t, MessageReqDto>> mq_batch; // drained mq, its capacity is kept across ticks
+
+		size_t window_bytes; // payload of cur_msgs
+		size_t arrivals; // since the last rate sample
+		JsonWriter window; // rendered messages joined into one array, its buffer is reused every flush
+		JsonWriter scratch; // on_message() renders here before the fragment is copied into arena
+		timer_id_t flush_timer; // armed while a window waits for more messages
+		bool flush_due;
+		double msg_rate; // EWMA of arrivals per second
+		msec64 last_arrival;
+
+		// end-to-end tracing, only with options.trace_every
+		uint64_t recv_stamp; // MessageTrace::now() of the readiness being handled
+		unsigned trace_skip; // client messages since the last sampled one
+		std::vector<MessageTrace::Stamps> traced; // sampled messages of cur_msgs
 	public:
-		ChatServer(const int max_fd = 32, const msec to = 0);
+		ChatServer(const int max_fd = 32, const msec to = 0, const bool listening = true);
 		~ChatServer();
 	protected:
 		virtual void resolve_deletion() override;
 		virtual void resolve_timestamps();
         virtual void resolve_broadcast();
+		void flush_window();
+		void broadcast_pieces(std::vector<fd_t>& clients, const std::shared_ptr<void>& keep, std::vector<fd_t>& failed); // the window cut into frames of MAX_FRAME_SIZE
 
 		// Hooks
-		virtual void on_req(const fd_t from, const char* target, Json& root) override; // handle both pure json & payload
+		virtual void on_message(const fd_t from, const WireRequest& req) override;
+		virtual void on_recv(const fd_t from) override;
+
+		bool append_window(const msec64 timestamp, std::string_view json); // false if json fits no frame comm can send, dropped
+		void reject_oversized(const fd_t from);
+
+		static bool render(MessageReqDto& msg); // fills msg.json on the producing thread while msg.user still resolves, false if it cannot be encoded
+		static bool render(JsonWriter& w, const MsgType type, std::string_view user_name, std::string_view text, const msec64 timestamp, const ch_id_t channel_id = 0);
+	private:
+		msec flush_delay() const; // how long the current window may wait for company
+		void sort_window(); // stable bottom-up merge sort, usually a single in-order check
 };
 
 #endif
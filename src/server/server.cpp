@@ -1,37 +1,114 @@
 #include <cstring>
 #include <csignal>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 #include "../libs/util.h"
+#include "../libs/binary_communication.h"
 #include "channel_server.h"
+#include "channel_registry.h"
+#include "channel_scheduler.h"
 
-ChannelServer* g_server = nullptr;
+std::vector<ChannelServer*> g_servers;
 
 void signal_handler(int signum) {
-    if (g_server) {
-        LOG("Signal %d received. Stopping server...", signum);
-        g_server->stop();
+    LOG("Signal %d received. Stopping server...", signum);
+    for (ChannelServer* server : g_servers) {
+        server->stop();
     }
 }
 
 int main(int argc, char* argv[]) {
     // if one of argv's key is lobbyN or chN, parse the its value as max fd of ChannelServer
 	int lobby_max_fd = 32, ch_max_fd = 32;
+	ServerOptions options;
 	for (int i = 1; i < argc; i++) {
 		if (strncmp(argv[i], "lobbyN=", 7) == 0) {
 			lobby_max_fd = atoi(argv[i] + 7);
 		} else if (strncmp(argv[i], "chN=", 4) == 0) {
 			ch_max_fd = atoi(argv[i] + 4);
+		} else if (strncmp(argv[i], "port=", 5) == 0) {
+			options.port = argv[i] + 5;
+		} else if (strncmp(argv[i], "backlog=", 8) == 0) {
+			options.backlog = std::max(1, atoi(argv[i] + 8));
+		} else if (strncmp(argv[i], "accept_budget=", 14) == 0) { // accepts per tick
+			options.accept_budget = std::max(1, atoi(argv[i] + 14));
+		} else if (strncmp(argv[i], "trigger=", 8) == 0) { // level (default) | edge
+			options.edge_triggered = strcmp(argv[i] + 8, "edge") == 0;
+		} else if (strncmp(argv[i], "lobbies=", 8) == 0) { // lobby shards, each with its own SO_REUSEPORT listener
+			options.lobby_shards = std::max(1, atoi(argv[i] + 8));
+		} else if (strncmp(argv[i], "frame=", 6) == 0) { // hex (default) | auto
+			options.binary_frames = strcmp(argv[i] + 6, "auto") == 0;
+		} else if (strncmp(argv[i], "workers=", 8) == 0) { // channel worker threads, 0 => one per core
+			options.channel_workers = std::max(0, atoi(argv[i] + 8));
+		} else if (strncmp(argv[i], "io=", 3) == 0) { // epoll (default) | uring
+			options.io_uring = strcmp(argv[i] + 3, "uring") == 0;
+		} else if (strncmp(argv[i], "batch=", 6) == 0) { // messages per broadcast window
+			options.batch_msgs = std::max(1, atoi(argv[i] + 6));
+		} else if (strncmp(argv[i], "batch_bytes=", 12) == 0) {
+			options.batch_bytes = static_cast<size_t>(std::max(1, atoi(argv[i] + 12)));
+		} else if (strncmp(argv[i], "batch_delay=", 12) == 0) { // max ms a message waits for its window, 0 => every tick
+			options.batch_delay = std::max(0, atoi(argv[i] + 12));
+		} else if (strncmp(argv[i], "timing=", 7) == 0) { // off (default) | on, task latency histograms
+			options.task_timing = strcmp(argv[i] + 7, "on") == 0;
+		} else if (strncmp(argv[i], "admin_port=", 11) == 0) { // Prometheus metrics on 127.0.0.1, off unless given
+			options.admin_port = argv[i] + 11;
+		} else if (strncmp(argv[i], "trace=", 6) == 0) { // trace one message in N end to end, 0 (default) => off
+			options.trace_every = static_cast<unsigned>(std::max(0, atoi(argv[i] + 6)));
 		}
 	}
+	// a window never outgrows the largest frame in use, hex peers of a binary server get larger ones cut up
+	options.batch_bytes = std::min<size_t>(options.batch_bytes, options.binary_frames ? MAX_BINARY_FRAME_SIZE : MAX_FRAME_SIZE);
+	ServerBase::configure(options);
+
+	ChannelScheduler scheduler(options.channel_workers);
+	ChannelRegistry registry(scheduler, ch_max_fd);
+	std::vector<std::unique_ptr<ChannelServer>> shards;
+	for (int i = 0; i < options.lobby_shards; i++) {
+		shards.emplace_back(new ChannelServer(registry, lobby_max_fd));
+		g_servers.push_back(shards.back().get());
+	}
+
+	if (!options.admin_port.empty()) {
+		shards[0]->open_admin(options.admin_port); // served by the first lobby's own loop
+	}
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-	ChannelServer server(lobby_max_fd, ch_max_fd);
-    g_server = &server;
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < shards.size(); i++) {
+		workers.emplace_back(&ChannelServer::proc, shards[i].get());
+	}
+    shards[0]->proc();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
 
-    server.proc();
+	if (options.task_timing) {
+		JsonWriter w;
+		w.begin_object();
+		w.key("lobbies");
+		w.begin_array();
+		for (std::unique_ptr<ChannelServer>& shard : shards) {
+			shard->export_timings(w);
+		}
+		w.end_array();
+		w.key("channels");
+		registry.export_timings(w);
+		w.end_object();
+		LOG("Task timings (ns): %s", w.str().c_str());
+	}
+	if (options.trace_every) {
+		JsonWriter w;
+		MessageTrace::export_timings(w);
+		LOG("Message latency (ns): %s", w.str().c_str());
+	}
 
-    g_server = nullptr;
+	registry.shutdown(); // channels report to their shards, so they go first
+	scheduler.stop();
+    g_servers.clear();
     return 0;
 }
\ No newline at end of file
@@ -1,33 +1,57 @@
 #include "server_base.h"
 
-fd_t ServerBase::fd = -1;
+ServerOptions ServerBase::options;
 
-ServerBase::ServerBase(const int max_fd, const msec to): con_tracker(nullptr), comm(nullptr), timeout(to), is_running(true) {
+ServerBase::ServerBase(const int max_fd, const msec to, const bool listening): listen_fd(FD_ERR), con_tracker(nullptr), comm(nullptr), timeout(to), wake_fd(FD_ERR), timer_fd(FD_ERR), timer_fd_due(0), listening(listening), accept_ready(false), admin_fd(FD_ERR), is_running(true) {
     try {
         branch_id = static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(
         std::chrono::system_clock::now().time_since_epoch()).count());
 
-        if (fd == FD_ERR)
+        if (listening) {
             set_network();
+            LOG(_CG_ "Server initialized on port %s." _EC_, options.port.c_str());
+        }
 
-        LOG(_CG_ "Server initialized on port 4800." _EC_);
-
-        con_tracker = new ConnectionTracker(fd, max_fd);
+        con_tracker = new ConnectionTracker(listen_fd, max_fd, options.edge_triggered);
         if (!con_tracker)
             throw std::runtime_error("Failed to allocate Connection Tracker.");
-        con_tracker->init();
+        con_tracker->init(listening);
+
+		if (timeout != 0) { // a loop that sleeps in epoll_wait() needs a way to be woken from other threads
+			wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (wake_fd == FD_ERR)
+				throw std::runtime_error("Failed to create wakeup eventfd.");
+			con_tracker->watch_internal(wake_fd);
+		} else { // ticked by a scheduler that only watches our epoll fd
+			timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+			if (timer_fd == FD_ERR)
+				throw std::runtime_error("Failed to create timerfd.");
+			con_tracker->watch_internal(timer_fd);
+		}
 
-		comm = new Communication();
+		IoEngine* engine = create_io_engine(options.io_uring);
+		if (options.binary_frames) {
+			comm = new BinaryCommunication(con_tracker, engine);
+		} else {
+			comm = new Communication(con_tracker, engine);
+		}
 
         task_runner.new_session(TS_COUNT);
+        task_runner.name_session(TS_PRE, "pre");
+        task_runner.name_session(TS_POLL, "poll");
+        task_runner.name_session(TS_LOGIC, "logic");
+        task_runner.set_timing(options.task_timing);
 		// Cleanup Qs
         task_runner.pushb(TS_PRE, [this]() {
             next_deletion.clear();
-        });
+        }, "clear_deletion");
 		// Polling
         task_runner.pushb(TS_POLL, [this]() {
-            con_tracker->polling(timeout);
-        });
+            msec to = accept_ready ? 0 : timeout; // leftover backlog must not wait for the next event
+            msec due = timers.next_timeout();
+            if (due >= 0 && (to < 0 || due < to)) to = due;
+            con_tracker->polling(to);
+        }, "polling");
 		// Handle Events
 		task_runner.pushb(TS_POLL, [this]() {
 			const pollev* events = con_tracker->get_ev();
@@ -36,11 +60,19 @@ ServerBase::ServerBase(const int max_fd, const msec to): con_tracker(nullptr), c
 			for (int i = 0; i < evcnt; i++) {
 				handle_events(events[i]);
 			}
-		});
-		// Deletion fds
+			if (accept_ready) {
+				accept_ready = accept_clients();
+			}
+			timers.advance();
+		}, "handle_events");
+		// Issue writes queued this tick (io_uring), then deletion fds
         task_runner.pushb(TS_LOGIC, [this]() {
+            for (const fd_t fd : comm->submit()) {
+                next_deletion.insert(fd);
+            }
             resolve_deletion();
-        });
+            if (timer_fd != FD_ERR) arm_timer_fd();
+        }, "resolve_deletion");
     } catch (const std::exception& e) {
         iERROR("%s", e.what());
     }
@@ -53,15 +85,21 @@ ServerBase::~ServerBase() {
 	if (comm)
 		delete comm;
 
-    if (fd != FD_ERR) { // close listening socket
-        close(fd);
-        fd = FD_ERR;
+    if (listen_fd != FD_ERR) { // close listening socket
+        close(listen_fd);
+        listen_fd = FD_ERR;
     }
 
+    if (admin_fd != FD_ERR) close(admin_fd);
+    for (const AdminConn& conn : admin_conns) close(conn.fd);
+    if (wake_fd != FD_ERR) close(wake_fd);
+    if (timer_fd != FD_ERR) close(timer_fd);
+
     next_deletion.clear();
 }
 
 void ServerBase::proc() {
+    task_runner.freeze(); // every constructor has registered its tasks, run() takes no lock from here on
     while (is_running) {
         try {
             task_runner.run();
@@ -74,11 +112,76 @@ void ServerBase::proc() {
 
 void ServerBase::stop() {
     is_running = false;
+    wake();
+}
+
+void ServerBase::wake() {
+    if (wake_fd != FD_ERR) eventfd_write(wake_fd, 1);
+}
+
+void ServerBase::configure(const ServerOptions& opts) {
+    options = opts;
+}
+
+void ServerBase::export_timings(JsonWriter& w) const {
+    w.begin_array();
+    task_runner.for_each_timing([&w](const char* session, const char* task, const LatencyHistogram& h) {
+        w.begin_object();
+        w.key("session");
+        w.value(session ? session : "");
+        w.key("task");
+        w.value(task ? task : ""); // "" is the whole session
+        w.key("count");
+        w.value(static_cast<long long>(h.count()));
+        w.key("p50");
+        w.value(static_cast<long long>(h.percentile(0.5)));
+        w.key("p99");
+        w.value(static_cast<long long>(h.percentile(0.99)));
+        w.key("p999");
+        w.value(static_cast<long long>(h.percentile(0.999)));
+        w.key("max");
+        w.value(static_cast<long long>(h.max()));
+        w.end_object();
+    });
+    w.end_array();
+}
+
+void ServerBase::open_admin(const std::string& port) {
+    sAddrInfo hints, *res = nullptr;
+    try {
+        if (admin_fd != FD_ERR) throw std::runtime_error("Admin port is already open.");
+        if (!con_tracker) throw std::runtime_error("Admin port needs a connection tracker.");
+
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo("127.0.0.1", port.c_str(), &hints, &res) != 0) { // loopback only, metrics are not for the outside
+            res = nullptr;
+            throw runtime_errorf("The admin port %s is not resolved.", port.c_str());
+        }
+
+        admin_fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol);
+        if (admin_fd == FD_ERR) throw std::runtime_error("Failed to get admin socket fd.");
+        int reuse = 1;
+        setsockopt(admin_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (FAILED(bind(admin_fd, res->ai_addr, res->ai_addrlen))) throw runtime_errorf("Failed to bind admin port %s.", port.c_str());
+        if (FAILED(listen(admin_fd, ADMIN_MAX_CONNS))) throw std::runtime_error("Failed to set listen() on admin port.");
+        freeaddrinfo(res);
+        res = nullptr;
+
+        con_tracker->watch_internal(admin_fd);
+        LOG(_CG_ "Metrics served on 127.0.0.1:%s." _EC_, port.c_str());
+    } catch (const std::exception& e) {
+        if (res) freeaddrinfo(res);
+        if (admin_fd != FD_ERR) close(admin_fd);
+        admin_fd = FD_ERR;
+        iERROR("%s", e.what());
+    }
 }
 
 #pragma region PRIVATE_FUNC
 void ServerBase::set_network() {
-    if (fd != FD_ERR) {
+    if (listen_fd != FD_ERR) {
         throw std::runtime_error("Sever descriptor is already assigned.");
     }
 
@@ -90,25 +193,36 @@ void ServerBase::set_network() {
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_flags = AI_PASSIVE;
 
-    status = getaddrinfo(NULL, "4800", &hints, &res);
+    status = getaddrinfo(NULL, options.port.c_str(), &hints, &res);
     if (status != 0) {
         throw std::runtime_error("The getaddrinfo() is not resolved.");
     }
 
-    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (fd == FD_ERR) {
+    listen_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (listen_fd == FD_ERR) {
         throw std::runtime_error("Failed to get socket fd.");
     }
 
     int reuse = 1;
-    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (options.lobby_shards > 1) { // every lobby shard binds its own listener, the kernel spreads connections
+        if (FAILED(setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)))) {
+            throw std::runtime_error("Failed to set SO_REUSEPORT.");
+        }
+    }
 
-    status = bind(fd, res->ai_addr, res->ai_addrlen);
+    // accept() must never block the loop: another poller may have taken the connection first
+    int flags = fcntl(listen_fd, F_GETFL, 0);
+    if (FAILED(flags) || FAILED(fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK))) {
+        throw std::runtime_error("Failed to set listening socket non-blocking.");
+    }
+
+    status = bind(listen_fd, res->ai_addr, res->ai_addrlen);
     if (status == -1) {
         throw std::runtime_error("Failed to bind server.");
     }
 
-    status = listen(fd, 5);
+    status = listen(listen_fd, options.backlog);
     if (status == -1) {
         throw std::runtime_error("Failed to set listen().");
     }
@@ -117,24 +231,129 @@ void ServerBase::set_network() {
 }
 
 void ServerBase::handle_events(const pollev event) {
-    fd_t fd = event.data.fd;
+    fd_t fd = ConnectionTable::fd_of(event.data.u64);
     uint32_t evs = event.events;
 
-    if (fd == ServerBase::fd) {
-		if (!con_tracker) return;
-		fd_t client = accept(ServerBase::fd, nullptr, nullptr);
-		if (client == FD_ERR) {
-			iERROR("Failed to accept new connection.");
-		} else {
-			on_accept(client);
-			LOG("Accepted new connection: fd %d", client);
-		}
+    if (fd == listen_fd) {
+		accept_ready = true; // drained once all events of this tick are handled
+	} else if (fd == wake_fd && wake_fd != FD_ERR) {
+		eventfd_t cnt;
+		eventfd_read(wake_fd, &cnt); // the tick itself is the response, only reset the counter
+	} else if (fd == timer_fd && timer_fd != FD_ERR) {
+		uint64_t expirations;
+		if (read(timer_fd, &expirations, sizeof(expirations)) > 0) timer_fd_due = 0; // the wheel advances right after
+	} else if (fd == admin_fd && admin_fd != FD_ERR) {
+		accept_admin();
+	} else if (!admin_conns.empty() && serve_admin(fd)) {
+		return; // a scraper, not a client
+	} else if (!ConnectionTable::is_current(event.data.u64)) {
+		return; // closed after it was polled, the number may already be someone else's
     } else if (evs & (EPOLLHUP | EPOLLERR)) {
 		on_disconnect(fd);
-	} else if (evs & EPOLLIN) {
-        on_recv(fd);
+	} else {
+		if (evs & EPOLLOUT) on_send(fd);
+		if (evs & EPOLLIN) on_recv(fd);
+		if (evs & EPOLLRDHUP) on_disconnect(fd); // peer half-closed, frames read above are still handled
     }
-    // 필요하면 EPOLLOUT도 처리
+}
+
+bool ServerBase::accept_clients() {
+	if (!con_tracker) return false;
+	sample_accept_queue();
+	for (int i = 0; i < options.accept_budget; i++) {
+		fd_t client = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client == FD_ERR) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return false; // backlog drained
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			Metrics::add(M_ACCEPT_FAILED);
+			iERROR("Failed to accept new connection: %s", strerror(errno));
+			return false; // EMFILE and friends: retry on the next readiness
+		}
+		on_accept(client);
+		LOG("Accepted new connection: fd %d", client);
+	}
+
+	Metrics::add(M_ACCEPT_DEFERRED);
+	return true;
+}
+
+void ServerBase::accept_admin() {
+	while (true) {
+		fd_t conn = accept4(admin_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (conn == FD_ERR) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			return; // EAGAIN, or out of fds: the scraper retries on its own
+		}
+		if (admin_conns.size() >= ADMIN_MAX_CONNS) {
+			close(conn);
+			continue;
+		}
+		try {
+			con_tracker->watch_internal(conn); // answered once its request shows up
+			timer_id_t timer = timers.arm(ADMIN_TIMEOUT, [this, conn]() { // an idle one would hold its slot for good
+				auto it = std::find_if(admin_conns.begin(), admin_conns.end(), [conn](const AdminConn& c) { return c.fd == conn; });
+				if (it == admin_conns.end()) return;
+				close(conn);
+				admin_conns.erase(it);
+			});
+			admin_conns.push_back({conn, timer});
+		} catch (const std::exception& e) {
+			close(conn);
+			iERROR("%s", e.what());
+		}
+	}
+}
+
+bool ServerBase::serve_admin(const fd_t fd) {
+	auto it = std::find_if(admin_conns.begin(), admin_conns.end(), [fd](const AdminConn& c) { return c.fd == fd; });
+	if (it == admin_conns.end()) return false;
+
+	char req[1024];
+	ssize_t got = 0, n;
+	while ((n = recv(fd, req, sizeof(req), MSG_DONTWAIT)) > 0) got += n; // drained, or close() would reset the reply
+	if (got == 0 && n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true; // nothing yet
+
+	if (got > 0) { // any request gets the metrics, method and path are not looked at
+		std::string reply;
+		Metrics::render(reply);
+		MessageTrace::render(reply);
+		char header[160];
+		int len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", reply.size());
+		reply.insert(0, header, static_cast<size_t>(len));
+		send(fd, reply.data(), reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL); // a few KiB fit the fresh socket's buffer
+	}
+	close(fd); // also leaves the epoll set
+	timers.cancel(it->timer); // the fd number may be reused by the next scraper
+	admin_conns.erase(it);
+	return true;
+}
+
+void ServerBase::arm_timer_fd() {
+	msec64 due = timers.next_deadline();
+	if (due == timer_fd_due) return;
+
+	struct itimerspec spec{}; // all zero disarms
+	if (due != 0) { // steady_clock is CLOCK_MONOTONIC, a deadline already past fires at once
+		spec.it_value.tv_sec = due / 1000;
+		spec.it_value.tv_nsec = (due % 1000) * 1000000L;
+	}
+	if (FAILED(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr))) {
+		iERROR("Failed to arm timerfd: %s", strerror(errno));
+		return;
+	}
+	timer_fd_due = due;
+}
+
+void ServerBase::sample_accept_queue() {
+	struct tcp_info info{};
+	socklen_t len = sizeof(info);
+	if (FAILED(getsockopt(listen_fd, IPPROTO_TCP, TCP_INFO, &info, &len))) return;
+
+	// on a listener tcpi_unacked is the current accept queue length and tcpi_sacked its limit
+	if (info.tcpi_sacked > 0 && info.tcpi_unacked >= info.tcpi_sacked) {
+		Metrics::add(M_ACCEPT_QUEUE_FULL);
+		iERROR("Accept queue full (%u/%u), new connections are being dropped.", info.tcpi_unacked, info.tcpi_sacked);
+	}
 }
 #pragma endregion
 
@@ -146,38 +365,48 @@ void ServerBase::handle_events(const pollev event) {
 
 void ServerBase::resolve_deletion() {
 	if (!con_tracker) return;
+	if (!next_deletion.empty()) Metrics::add(M_DELETIONS, next_deletion.size());
     for (const fd_t fd : next_deletion) {
 		try {
         	con_tracker->delete_client(fd);
 		} catch (...) {
 			continue;
 		}
+		comm->clear_buffer(fd); // before close(): a write still queued for fd must not reach its next owner
+		ConnectionTable::close(fd);
         close(fd);
-		comm->clear_buffer(fd);
         LOG("Normally Disconnected: fd %d", fd);
     }
 }
 
-void ServerBase::on_frame(const fd_t from, const std::string& frame) {
+void ServerBase::on_frame(const fd_t from, std::string_view frame) {
     // Default implementation does nothing
 }
 
 void ServerBase::on_accept(const fd_t client) {
+	comm->open(client);
 	try {
         con_tracker->add_client(client);
 	} catch (const std::exception& e) {
 		if (dynamic_cast<const coded_runtime_error*>(&e) != nullptr) {
 			const coded_runtime_error& cre = static_cast<const coded_runtime_error&>(e);
 			if (cre.code == POOL_FULL) {
-				comm->send_frame(client, std::string(R"({"type":"error","message":"Server is full."})"));
+				comm->send_direct(client, R"({"type":"error","message":"Server is full."})");
 			}
 		}
         iERROR("%s", e.what());
-        next_deletion.insert(client);
+        discard(client); // never tracked, resolve_deletion() would skip it
 		return;
     }
 }
 
+void ServerBase::discard(const fd_t fd) {
+	comm->clear_buffer(fd);
+	ConnectionTable::close(fd);
+	close(fd);
+	LOG("Rejected: fd %d", fd);
+}
+
 void ServerBase::on_disconnect(const fd_t fd) {
 	next_deletion.insert(fd);
 }
@@ -185,14 +414,23 @@ void ServerBase::on_disconnect(const fd_t fd) {
 void ServerBase::on_recv(const fd_t from) {
 	try {
 		if (!comm) return;
-		std::vector<std::string> frames = comm->recv_frame(from);
-		for (const std::string& frame : frames) {
+		comm->recv_frame(from, [this, from](std::string_view frame) {
             on_frame(from, frame);
-        }
+        });
     } catch (const std::exception& e) {
         iERROR("%s", e.what());
         next_deletion.insert(from);
     }
 }
 
+void ServerBase::on_send(const fd_t to) {
+	try {
+		if (!comm) return;
+		comm->flush(to);
+	} catch (const std::exception& e) {
+		iERROR("%s", e.what());
+		next_deletion.insert(to);
+	}
+}
+
 #pragma endregion
@@ -2,11 +2,14 @@
 #define __SERVER_BASE_H__
 
 #define iERROR(...)         LOG2(_CR_ "[%x] " _EC_, branch_id); ERROR(__VA_ARGS__)
+#define ADMIN_MAX_CONNS     8 // scrapers served at once, more are turned away
+#define ADMIN_TIMEOUT       2000 // ms a scraper has to send its request before it is closed
 
 #include <unordered_map>
 #include <unordered_set>
 #include <map>
 #include <string>
+#include <string_view>
 #include <deque>
 #include <functional>
 #include <stdexcept>
@@ -14,9 +17,15 @@
 #include <shared_mutex>
 #include <cstring>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/types.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
 #include <algorithm>
@@ -26,10 +35,32 @@
 #include "../libs/socket.h"
 #include "../libs/connection_tracker.h"
 #include "../libs/task_runner.h"
+#include "../libs/timer_wheel.h"
 #include "../libs/communication.h"
+#include "../libs/binary_communication.h"
+#include "../libs/json_writer.h"
+#include "../libs/metrics.h"
+#include "../libs/message_trace.h"
+
+struct ServerOptions {
+    std::string port = "4800";
+    int backlog = 1024; // listen() queue, capped by net.core.somaxconn
+    int accept_budget = 64; // accepts per tick before the rest waits for the next tick
+    bool edge_triggered = false; // EPOLLET | EPOLLRDHUP; reads drain to EAGAIN
+    int lobby_shards = 1; // listening servers sharing the port through SO_REUSEPORT
+    bool binary_frames = false; // negotiate the 4-byte big-endian header per connection, hex stays for old clients
+    bool io_uring = false; // batch each tick's writes into one io_uring_enter(), epoll still reports readiness
+    int channel_workers = 0; // threads ticking channels, 0 => one per core
+    size_t batch_msgs = 128; // a broadcast window is flushed once it holds this many messages
+    size_t batch_bytes = 12288; // ... or roughly this many payload bytes, at most the largest frame in use
+    msec batch_delay = 20; // ... or when its oldest message has waited this long, 0 => flush every tick
+    bool task_timing = false; // per-task and per-session latency histograms in every TaskRunner
+    std::string admin_port; // Prometheus metrics on 127.0.0.1, empty => none
+    unsigned trace_every = 0; // one client message in this many is traced end to end, 0 => none
+};
 
 /*
-All servers have only one shared file descriptor listening on a port.
+Every listening server owns its own socket on the port (SO_REUSEPORT when sharded).
 ServerBase assumed that it has one channel.
 */
 
@@ -41,7 +72,8 @@ ServerBase assumed that it has one channel.
 
 class ServerBase {
     protected:
-        static fd_t fd;
+        fd_t listen_fd; // FD_ERR unless listening
+        static ServerOptions options; // process-wide, set before the first server is constructed
     protected:
         int branch_id; // manager branch's id
         ConnectionTracker* con_tracker;
@@ -54,33 +86,57 @@ class ServerBase {
             TS_COUNT = 3
         };
 
-        msec timeout;
+        msec timeout; // poll timeout, -1 blocks until an fd, wake() or the next timer is due
+        fd_t wake_fd; // eventfd, only for loops that may block
+        fd_t timer_fd; // timerfd, only for loops ticked from outside: the next timer shows up as readiness
+        msec64 timer_fd_due; // deadline timer_fd is armed for, 0 if disarmed
+        TimerWheel timers; // advanced once per tick after polling
+        bool listening;
+        bool accept_ready; // listener had pending connections at the end of the last accept batch
+        fd_t admin_fd; // metrics listener, FD_ERR unless open_admin()
+        struct AdminConn {
+            fd_t fd;
+            timer_id_t timer; // closes it at ADMIN_TIMEOUT, cancelled once served
+        };
+        std::vector<AdminConn> admin_conns; // scrapers waiting for their request to arrive
 
         std::unordered_set<fd_t> next_deletion;
 
         TaskRunner<void()> task_runner;
         std::atomic<bool> is_running;
     public:
-        ServerBase(const int max_fd = 256, const msec to = 0);
+        ServerBase(const int max_fd = 256, const msec to = 0, const bool listening = true); // only listening servers accept and own the listener
         ~ServerBase();
 
         virtual void proc(); // 외부에서의 서버 진입점
         void stop();
+        void wake(); // thread- and signal-safe, interrupts a blocking poll
 
+        static void configure(const ServerOptions& opts);
+        void export_timings(JsonWriter& w) const; // array of {session, task, count, p50, p99, p999, max} in ns, empty without task_timing
+        void open_admin(const std::string& port); // serves Metrics on 127.0.0.1:port from this loop, before proc()
 
     private:
         void set_network();
         void handle_events(const pollev event);
+        bool accept_clients(); // true if the budget ran out before the backlog did
+        void sample_accept_queue(); // at the start of every accept batch, while the queue is at its longest
+        void arm_timer_fd(); // follows the wheel's next deadline, re-armed only when it moves
+        void accept_admin();
+        bool serve_admin(const fd_t fd); // false if fd is no scraper of ours
     protected:
+
         // Tasks
         // virtual void frame();
         virtual void resolve_deletion();
+        void discard(const fd_t fd); // closes an fd the tracker never took, right away
 
         // Hooks
-        virtual void on_frame(const fd_t from, const std::string& frame);
+        virtual void on_frame(const fd_t from, std::string_view frame);
         virtual void on_accept(const fd_t client);
 		virtual void on_disconnect(const fd_t fd);
 		virtual void on_recv(const fd_t from);
+		virtual void on_send(const fd_t to);
 };
 
 #endif
@@ -1,18 +1,47 @@
 #include "typed_frame_server.h"
 
-TypedFrameServer::TypedFrameServer(const int max_fd, const msec to) : ServerBase(max_fd, to) {}
+TypedFrameServer::TypedFrameServer(const int max_fd, const msec to, const bool listening) : ServerBase(max_fd, to, listening) {}
+
+void TypedFrameServer::on_frame(const fd_t from, std::string_view frame) {
+    WireRequest req;
+    if (decoder.decode(frame, req)) { // plain join/message: no DOM
+        dispatch(from, req);
+        return;
+    }
 
-void TypedFrameServer::on_frame(const fd_t from, const std::string& frame) {
     json_error_t err;
-    Json root(json_loads(frame.c_str(), 0, &err));
+    Json root(json_loadb(frame.data(), frame.size(), 0, &err));
     if (root.get() == nullptr) {
         iERROR("Failed to parse JSON: %s", err.text);
         return;
     }
     const char* type;
     __UNPACK_JSON(root, "{s:s}", "type", &type) {
-        on_req(from, type, root);
+        if (RequestDecoder::from_json(root.get(), req)) {
+            dispatch(from, req);
+        } else {
+            on_req(from, type, root);
+        }
     } __UNPACK_FAIL {
         iERROR("Malformed JSON message, missing type.");
     }
-}
\ No newline at end of file
+}
+
+void TypedFrameServer::on_req(const fd_t from, const char* target, Json& root) {}
+void TypedFrameServer::on_join(const fd_t from, const WireRequest& req) {}
+void TypedFrameServer::on_message(const fd_t from, const WireRequest& req) {}
+
+#pragma region PRIVATE_FUNC
+void TypedFrameServer::dispatch(const fd_t from, const WireRequest& req) {
+    switch (req.kind) {
+    case WireRequest::JOIN:
+        on_join(from, req);
+        break;
+    case WireRequest::MESSAGE:
+        on_message(from, req);
+        break;
+    default:
+        break;
+    }
+}
+#pragma endregion
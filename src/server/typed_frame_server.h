@@ -3,15 +3,24 @@
 
 #include "server_base.h"
 #include "../libs/json.h"
+#include "../libs/request_codec.h"
 
 class TypedFrameServer : public ServerBase {
+private:
+    RequestDecoder decoder;
 public:
-    TypedFrameServer(const int max_fd = 256, const msec to = 0);
+    TypedFrameServer(const int max_fd = 256, const msec to = 0, const bool listening = true);
     virtual ~TypedFrameServer() = default;
 
 protected:
-    virtual void on_frame(const fd_t from, const std::string& frame) override;
-    virtual void on_req(const fd_t from, const char* target, Json& root) = 0;
+    virtual void on_frame(const fd_t from, std::string_view frame) override;
+    virtual void on_req(const fd_t from, const char* target, Json& root); // types without a decoder hook
+
+    // join/message, decoded in place or from the jansson DOM; check req.has() for the members needed
+    virtual void on_join(const fd_t from, const WireRequest& req);
+    virtual void on_message(const fd_t from, const WireRequest& req);
+private:
+    void dispatch(const fd_t from, const WireRequest& req);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,24 +1,15 @@
 #include "user_manager.h"
 
-std::unordered_map<fd_t, std::string> UserManager::name_map;
-std::shared_mutex UserManager::name_map_mtx;
+user_id_t UserManager::user_of(const fd_t fd) {
+    return ConnectionTable::at(fd).user.load(std::memory_order_acquire);
+}
 
 bool UserManager::get_user_name(const fd_t fd, std::string& out_user_name) {
-    std::shared_lock<std::shared_mutex> lock(name_map_mtx);
-    auto it = name_map.find(fd);
-    if (it == name_map.end()) {
-        return false;
-    }
-    out_user_name = it->second;
-    return true;
+    return NameTable::resolve(user_of(fd), out_user_name);
 }
 
-void UserManager::set_user_name(const fd_t fd, const std::string& user_name) {
-    std::unique_lock<std::shared_mutex> lock(name_map_mtx);
-    name_map[fd] = user_name;
+void UserManager::set_user_name(const fd_t fd, std::string_view user_name) {
+    Connection& conn = ConnectionTable::at(fd);
+    user_id_t user = NameTable::intern(user_name);
+    NameTable::release(conn.user.exchange(user, std::memory_order_acq_rel));
 }
-
-void UserManager::remove_user_name(const fd_t fd) {
-    std::unique_lock<std::shared_mutex> lock(name_map_mtx);
-    name_map.erase(fd);
-}
\ No newline at end of file
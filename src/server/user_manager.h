@@ -2,21 +2,18 @@
 #define __USER_MANAGER_H__
 
 #include <string>
-#include <unordered_map>
-#include <shared_mutex>
-#include <mutex>
+#include <string_view>
 
 #include "../libs/socket.h"
+#include "../libs/connection_table.h"
+#include "../libs/name_table.h"
 
+// names are interned in NameTable, the connection's ConnectionTable slot holds the id and drops it on close
 class UserManager {
-private:
-    static std::unordered_map<fd_t, std::string> name_map;
-    static std::shared_mutex name_map_mtx;
-
 public:
-    static bool get_user_name(const fd_t fd, std::string& out_user_name);
-    static void set_user_name(const fd_t fd, const std::string& user_name);
-    static void remove_user_name(const fd_t fd);
+    static user_id_t user_of(const fd_t fd); // NO_USER until a name is set
+    static bool get_user_name(const fd_t fd, std::string& out_user_name); // copies, prefer NameTable::with_name(user_of(fd), ...)
+    static void set_user_name(const fd_t fd, std::string_view user_name);
 };
 
-#endif
\ No newline at end of file
+#endif